@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "anonymize.hpp"
+
+#include <array>
+#include <cstdio>  // std::snprintf
+#include <cstring> // std::memcpy, std::memset
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+#include "framing.hpp"
+#include "parallel.hpp"
+#include "print_names.hpp"
+#include "recompress.hpp"
+#include "replay_file.hpp"
+#include "sha256.hpp"
+
+namespace
+{
+
+#include "read.inl"
+
+constexpr size_t NAME_SIZE = 40U;
+
+// NOTE: HMAC-SHA256 keyed by the salt, so pseudonyms can be neither reversed
+// nor computed for a list of known names without it. Its first 48 bits are
+// kept.
+auto pseudonym(std::string_view salt, std::string_view name) noexcept
+	-> std::string
+{
+	if(name.empty())
+		return {};
+	auto const mac = hmac_sha256(salt, name);
+	std::array<char, 32U> buf{};
+	std::snprintf(buf.data(), buf.size(), "Anon-%02x%02x%02x%02x%02x%02x",
+	              mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	return buf.data();
+}
+
+// Overwrites the name slots at `ptr`, in the same order `read_names` reads
+// them, with the pseudonyms of the names they hold. Fails if they don't fit
+// in the `size` bytes at `ptr`.
+auto rewrite_names(std::string_view salt, uint32_t flags, uint8_t* ptr,
+                   size_t size) noexcept -> bool
+{
+	auto const r = read_names(flags, ptr, size);
+	if(!r.has_value())
+		return false;
+	auto const& names = r->names;
+	auto it = names.begin();
+	auto write_one = [&]()
+	{
+		auto const p = pseudonym(salt, *it++);
+		std::memset(ptr, 0, NAME_SIZE);
+		// NOTE: Pseudonyms are ASCII, so UTF-16 is the same byte widened.
+		for(size_t i = 0U; i < p.size() && (2U * i) + 2U < NAME_SIZE; i++)
+			ptr[2U * i] = static_cast<uint8_t>(p[i]);
+		ptr += NAME_SIZE;
+	};
+	if((flags & REPLAY_SINGLE_MODE) != 0U)
+	{
+		write_one();
+		write_one();
+		return true;
+	}
+	// NOTE: Same layout `read_names` already checked.
+	for(int i = 2; i != 0; --i)
+		for(uint32_t j = read<uint32_t>(ptr); j != 0; --j)
+			write_one();
+	return true;
+}
+
+auto anonymize(std::string_view exe, std::string_view fn,
+               std::string const& out_path, std::string_view salt) noexcept
+	-> bool
+{
+	auto [success, header, buffer, file_size] = load_replay(exe, fn);
+	if(!success)
+		return false; // NOTE: Error printed by `load_replay`.
+	if(!rewrite_names(salt, header.base.flags, buffer.data(), buffer.size()))
+	{
+		std::cerr << exe << ": Replay is truncated.\n";
+		return false;
+	}
+	auto* ptr_to_msgs = buffer.data();
+	auto const* const sentry = ptr_to_msgs + buffer.size();
+	if(!skip_duelists(header.base.flags, ptr_to_msgs, sentry) ||
+	   !read_duel_flags(header.base.flags, ptr_to_msgs, sentry))
+	{
+		std::cerr << exe << ": Replay is truncated.\n";
+		return false;
+	}
+	auto const orm = find_old_replay_mode(
+		exe, ptr_to_msgs, buffer.size() - (ptr_to_msgs - buffer.data()));
+	if(!orm.success)
+		return false; // NOTE: Error printed by `find_old_replay_mode`.
+	if(orm.old_replay_mode_buffer != nullptr)
+	{
+		auto yrp = load_old_replay(exe, orm.old_replay_mode_buffer,
+		                           orm.old_replay_mode_size);
+		if(!yrp.success)
+			return false; // NOTE: Error printed by `load_old_replay`.
+		if(!rewrite_names(salt, yrp.header.base.flags, yrp.buffer, yrp.size))
+		{
+			std::cerr << exe << ": Yrp is truncated.\n";
+			return false;
+		}
+		// NOTE: Uncompressed contents were rewritten in place.
+		if((yrp.header.base.flags & REPLAY_COMPRESSED) != 0U)
+		{
+			auto const body = compress_body(exe, yrp.header, yrp.buffer,
+			                                yrp.size, std::nullopt);
+			if(body.empty())
+				return false; // NOTE: Error printed by `compress_body`.
+			buffer = replace_old_replay(buffer, orm.old_replay_mode_buffer,
+			                            orm.old_replay_mode_size,
+			                            serialize_replay(yrp.header, body));
+		}
+	}
+	// NOTE: yrpX replays are always compressed, fall back to the default
+	// preset otherwise as the header has no props to keep.
+	auto const preset = (header.base.flags & REPLAY_COMPRESSED) != 0U
+	                        ? std::nullopt
+	                        : std::optional<uint32_t>{6U};
+	auto const body =
+		compress_body(exe, header, buffer.data(), buffer.size(), preset);
+	if(body.empty())
+		return false; // NOTE: Error printed by `compress_body`.
+	header.base.flags |= REPLAY_COMPRESSED;
+	return write_file(exe, out_path, serialize_replay(header, body));
+}
+
+} // namespace
+
+auto anonymize_replays(std::string_view exe, std::string_view out_dir,
+                       std::vector<std::string_view> const& replays,
+                       unsigned jobs, std::string_view salt) noexcept -> bool
+{
+	// NOTE: Without a secret key anyone can compute the pseudonym of a name.
+	if(salt.empty())
+	{
+		std::cerr << exe << ": A non-empty --salt or --key-file is needed.\n";
+		return false;
+	}
+	bool all_success = true;
+	parallel_ordered(
+		replays.size(), jobs,
+		[&](size_t i) -> bool
+		{
+			auto const fn = replays[i];
+			auto const prefixed_exe = std::string{exe} + ": " + std::string{fn};
+			auto const out_path =
+				std::filesystem::path{out_dir} /
+				std::filesystem::path{fn}.filename();
+			std::error_code ec;
+			if(std::filesystem::equivalent(fn, out_path, ec))
+			{
+				std::cerr << prefixed_exe << ": Refusing to overwrite the "
+				          << "original replay.\n";
+				return false;
+			}
+			return anonymize(prefixed_exe, fn, out_path.string(), salt);
+		},
+		[&](size_t /*i*/, bool success)
+		{ all_success = all_success && success; });
+	return all_success;
+}
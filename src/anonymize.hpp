@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_ANONYMIZE_HPP
+#define ERP_ANONYMIZE_HPP
+#include <string_view>
+#include <vector>
+
+// Writes each replay to `out_dir`, under the same file name, with the names
+// of its duelists replaced by pseudonyms both in the yrpX and in its embedded
+// yrp. A pseudonym is a MAC of the name keyed by `salt`, so a player keeps the
+// same one across replays and it can't be linked back to the name without the
+// salt, which must not be empty. Up to `jobs` replays are rewritten in
+// parallel. Returns false if any replay failed.
+auto anonymize_replays(std::string_view exe, std::string_view out_dir,
+                       std::vector<std::string_view> const& replays,
+                       unsigned jobs, std::string_view salt) noexcept -> bool;
+
+#endif // ERP_ANONYMIZE_HPP
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "banlist.hpp"
+
+#include <algorithm> // std::sort
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "hash.hpp"
+
+auto Banlist::load(std::string_view exe, std::string_view path) noexcept -> bool
+{
+	std::ifstream f{std::string{path}};
+	if(!f.is_open())
+	{
+		std::cerr << exe << ": Could not open file '" << path << "'.\n";
+		return false;
+	}
+	bool in_list = false;
+	std::string line;
+	while(std::getline(f, line))
+	{
+		if(line.empty() || line[0] == '#')
+			continue;
+		if(line[0] == '!')
+		{
+			if(in_list)
+				break; // NOTE: Only the first list is used.
+			in_list = true;
+			continue;
+		}
+		if(line.rfind("$whitelist", 0U) == 0U)
+		{
+			whitelist_ = true;
+			continue;
+		}
+		std::istringstream ss{line};
+		uint32_t code{};
+		unsigned lim{};
+		if(!(ss >> code >> lim) || code == 0U)
+			continue; // NOTE: EDOPro ignores malformed lines too.
+		insert(code, std::min(lim, DEFAULT_LIMIT));
+	}
+	return true;
+}
+
+auto Banlist::limit(uint32_t code) const noexcept -> unsigned
+{
+	if(keys_.empty() || code == 0U)
+		return whitelist_ ? 0U : DEFAULT_LIMIT;
+	auto const mask = keys_.size() - 1U;
+	for(auto i = mix32(code) & mask;; i = (i + 1U) & mask)
+	{
+		if(keys_[i] == code)
+			return limits_[i];
+		if(keys_[i] == 0U)
+			return whitelist_ ? 0U : DEFAULT_LIMIT;
+	}
+}
+
+auto Banlist::check(std::vector<uint32_t>& codes) const noexcept
+	-> std::vector<BanlistViolation>
+{
+	std::vector<BanlistViolation> violations;
+	std::sort(codes.begin(), codes.end());
+	for(auto it = codes.begin(); it != codes.end();)
+	{
+		auto const code = *it;
+		unsigned count = 0U;
+		for(; it != codes.end() && *it == code; ++it)
+			count++;
+		if(auto const lim = limit(code); count > lim)
+			violations.push_back({code, count, lim});
+	}
+	return violations;
+}
+
+auto Banlist::insert(uint32_t code, unsigned limit) noexcept -> void
+{
+	if((count_ + 1U) * 2U > keys_.size())
+	{
+		auto old_keys = std::move(keys_);
+		auto old_limits = std::move(limits_);
+		keys_.assign(std::max<size_t>(64U, old_keys.size() * 2U), 0U);
+		limits_.assign(keys_.size(), 0U);
+		count_ = 0U;
+		for(size_t i = 0U; i < old_keys.size(); i++)
+			if(old_keys[i] != 0U)
+				insert(old_keys[i], old_limits[i]);
+	}
+	auto const mask = keys_.size() - 1U;
+	auto i = mix32(code) & mask;
+	while(keys_[i] != 0U && keys_[i] != code)
+		i = (i + 1U) & mask;
+	count_ += keys_[i] == 0U ? 1U : 0U;
+	keys_[i] = code;
+	limits_[i] = static_cast<uint8_t>(limit);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_BANLIST_HPP
+#define ERP_BANLIST_HPP
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+struct BanlistViolation
+{
+	uint32_t code;
+	unsigned count;
+	unsigned limit;
+};
+
+// Limits read from an EDOPro style banlist (lflist.conf), only the first list
+// in the file is used. Cards that are not listed can have up to 3 copies, or
+// none if the list is a whitelist.
+class Banlist final
+{
+public:
+	static constexpr unsigned DEFAULT_LIMIT = 3U;
+
+	auto load(std::string_view exe, std::string_view path) noexcept -> bool;
+
+	auto limit(uint32_t code) const noexcept -> unsigned;
+
+	// NOTE: `codes` is sorted in place.
+	auto check(std::vector<uint32_t>& codes) const noexcept
+		-> std::vector<BanlistViolation>;
+
+private:
+	auto insert(uint32_t code, unsigned limit) noexcept -> void;
+
+	// Open addressing table, a key of 0 marks an empty slot.
+	std::vector<uint32_t> keys_;
+	std::vector<uint8_t> limits_;
+	size_t count_{};
+	bool whitelist_{};
+};
+
+#endif // ERP_BANLIST_HPP
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include <algorithm> // std::clamp, std::replace
+#include <chrono>
+#include <cstdlib> // std::strtod, std::strtoul
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "bench_store.hpp"
+#include "commit.hpp"
+#include "parser.hpp"
+#include "replay_file.hpp"
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// Each repetition runs a benchmark for at least this long, averaging the
+// iterations, so that small replays aren't dominated by timer noise.
+constexpr double MIN_REPETITION_NS = 20e6;
+constexpr unsigned DEFAULT_REPETITIONS = 10U;
+constexpr double DEFAULT_THRESHOLD = 1.0; // Percent.
+
+auto print_usage(std::string_view exe) noexcept -> void
+{
+	std::cerr << "\nUsage: " << exe << " run [-n REPETITIONS] OUT REPLAY...\n"
+			  << "       " << exe
+			  << " compare [--threshold PERCENT] BASE HEAD\n\n";
+	std::cerr << "  run\t\tTime loading, analyzing and serializing each "
+				 "replay, and\n\t\tsave the samples to OUT along with the "
+				 "commit, compiler\n\t\tand host.\n";
+	std::cerr << "  compare\tReport the change of each benchmark from BASE "
+				 "to HEAD with\n\t\tits 95% confidence interval. Fails if one "
+				 "is significantly\n\t\tslower by more than PERCENT (default "
+			  << DEFAULT_THRESHOLD << ") or missing from HEAD.\n";
+}
+
+// `iteration` returns how many nanoseconds its timed part took, or nullopt if
+// it failed. After one warm-up iteration, which also decides how many make up
+// a repetition, returns the mean iteration time of each repetition.
+template<typename F>
+auto repeat(unsigned repetitions, F&& iteration) noexcept
+	-> std::optional<std::vector<double>>
+{
+	auto const warmup = iteration();
+	if(!warmup.has_value())
+		return std::nullopt;
+	auto const iterations = static_cast<unsigned>(
+		std::clamp(MIN_REPETITION_NS / std::max(*warmup, 1.0), 1.0, 1e6));
+	std::vector<double> samples;
+	samples.reserve(repetitions);
+	for(unsigned r = 0U; r < repetitions; r++)
+	{
+		double total = 0.0;
+		for(unsigned i = 0U; i < iterations; i++)
+		{
+			auto const ns = iteration();
+			if(!ns.has_value())
+				return std::nullopt;
+			total += *ns;
+		}
+		samples.push_back(total / iterations);
+	}
+	return samples;
+}
+
+template<typename F>
+auto time_ns(F&& f) noexcept -> std::optional<double>
+{
+	auto const start = Clock::now();
+	bool const success = f();
+	auto const end = Clock::now();
+	if(!success)
+		return std::nullopt;
+	return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+auto print_stats(std::string_view name, SampleStats const& s) noexcept -> void
+{
+	std::cout << std::left << std::setw(40) << name << std::right
+			  << std::fixed << std::setprecision(3) << std::setw(12)
+			  << s.mean / 1e3 << " us +- " << s.margin / 1e3 << " us\n";
+}
+
+auto run_benchmarks(std::string_view exe, unsigned repetitions,
+                    std::string_view out,
+                    std::vector<std::string_view> const& replays) noexcept
+	-> bool
+{
+	auto run = describe_build_and_host();
+	run.commit = ERP_COMMIT;
+	bool success = true;
+	auto add = [&](std::string name,
+	               std::optional<std::vector<double>> samples)
+	{
+		// NOTE: Names are stored in a tab separated file.
+		std::replace(name.begin(), name.end(), '\t', ' ');
+		std::replace(name.begin(), name.end(), '\n', ' ');
+		if(!samples.has_value())
+		{
+			std::cerr << exe << ": Benchmark '" << name << "' failed.\n";
+			success = false;
+			return;
+		}
+		print_stats(name, sample_stats(*samples));
+		run.samples[std::move(name)] = std::move(*samples);
+	};
+	for(auto const fn : replays)
+	{
+		auto const base = std::filesystem::path(fn).filename().string();
+		auto replay = load_replay(exe, fn);
+		if(!replay.success)
+		{
+			success = false;
+			continue; // NOTE: Error printed by `load_replay`.
+		}
+		if(((replay.header.base.version >> 16U) & 0xFFU) < 10U)
+		{
+			std::cerr << exe << ": Core version for '" << fn
+					  << "' is too old.\n";
+			success = false;
+			continue;
+		}
+		auto load_iteration = [&]()
+		{
+			return time_ns([&]() { return load_replay(exe, fn).success; });
+		};
+		add("load:" + base, repeat(repetitions, load_iteration));
+		auto const flags = replay.header.base.flags;
+		auto const msgs_offset = [&]() -> std::optional<size_t>
+		{
+			auto* ptr = replay.buffer.data();
+			auto const* const sentry = ptr + replay.buffer.size();
+			if(!skip_duelists(flags, ptr, sentry) ||
+			   !read_duel_flags(flags, ptr, sentry))
+				return std::nullopt;
+			return static_cast<size_t>(ptr - replay.buffer.data());
+		}();
+		if(!msgs_offset.has_value())
+		{
+			std::cerr << exe << ": Replay '" << fn << "' is truncated.\n";
+			success = false;
+			continue;
+		}
+		// NOTE: `analyze` rewrites the buffer in place, so every iteration
+		// gets a fresh copy, made outside of the timed section.
+		auto analyze_with = [&](AnalyzeOptions const& options)
+		{
+			std::vector<uint8_t> buffer;
+			auto iteration = [&]()
+			{
+				buffer = replay.buffer;
+				auto* const msgs = buffer.data() + *msgs_offset;
+				auto const size = buffer.size() - *msgs_offset;
+				return time_ns(
+					[&]() { return analyze(exe, msgs, size, options).success; });
+			};
+			return repeat(repetitions, iteration);
+		};
+		AnalyzeOptions options{};
+		add("analyze:" + base, analyze_with(options));
+		options.serialize_messages = true;
+		add("duel-msgs:" + base, analyze_with(options));
+	}
+	if(!write_bench_run(exe, out, run))
+		return false; // NOTE: Error printed by `write_bench_run`.
+	return success;
+}
+
+auto compare_runs(std::string_view exe, double threshold,
+                  std::string_view base_path,
+                  std::string_view head_path) noexcept -> bool
+{
+	auto const base = read_bench_run(exe, base_path);
+	auto const head = read_bench_run(exe, head_path);
+	if(!base.has_value() || !head.has_value())
+		return false; // NOTE: Error printed by `read_bench_run`.
+	std::cout << "base: " << base->commit << " (" << base->compiler << ")\n"
+			  << "head: " << head->commit << " (" << head->compiler << ")\n";
+	if(base->fingerprint != head->fingerprint)
+		std::cerr << exe << ": Runs are from different hosts ("
+				  << base->host << " and " << head->host
+				  << "), changes may not be meaningful.\n";
+	else if(base->compiler != head->compiler)
+		std::cerr << exe << ": Runs are from different compilers.\n";
+	auto const cmp = compare_bench_runs(*base, *head);
+	bool regressed = false;
+	for(auto const& d : cmp.deltas)
+	{
+		auto const verdict = [&]() -> std::string_view
+		{
+			if(!d.significant)
+				return "";
+			if(d.change < 0.0)
+				return "  faster";
+			if(d.change * 100.0 <= threshold)
+				return "  slower (within threshold)";
+			regressed = true;
+			return "  SLOWER";
+		}();
+		std::cout << std::left << std::setw(40) << d.name << std::right
+				  << std::fixed << std::setprecision(3) << std::setw(10)
+				  << d.base.mean / 1e3 << " us ->" << std::setw(10)
+				  << d.head.mean / 1e3 << " us" << std::showpos
+				  << std::setprecision(1) << std::setw(8) << d.change * 100.0
+				  << std::noshowpos << "% +- " << d.margin * 100.0 << "%"
+				  << verdict << '\n';
+	}
+	auto const list = [&](std::vector<std::string> const& names,
+	                      std::string_view what)
+	{
+		for(auto const& name : names)
+			std::cerr << exe << ": '" << name << "' " << what << ".\n";
+	};
+	list(cmp.missing_in_base, "is only in HEAD, not compared");
+	list(cmp.uncomparable, "has fewer than 2 samples in BASE, not compared");
+	// NOTE: A benchmark that stopped running (e.g. its replay now fails)
+	// would otherwise hide any regression in it.
+	list(cmp.missing_in_head, "is missing from HEAD or has fewer than 2 "
+	                          "samples there");
+	return !regressed && cmp.missing_in_head.empty();
+}
+
+} // namespace
+
+auto main(int argc, char* argv[]) -> int
+{
+	auto const exe = std::string_view{argv[0]};
+	if(argc >= 2 && std::string_view{argv[1]} == "run")
+	{
+		unsigned repetitions = DEFAULT_REPETITIONS;
+		int a = 2;
+		if(a + 1 < argc && std::string_view{argv[a]} == "-n")
+		{
+			repetitions =
+				static_cast<unsigned>(std::strtoul(argv[a + 1], nullptr, 10));
+			a += 2;
+		}
+		if(repetitions < 2U || argc - a < 2)
+		{
+			std::cerr << exe
+					  << ": Expected at least 2 repetitions, OUT and "
+						 "REPLAY.\n";
+			print_usage(exe);
+			return EXIT_FAILURE;
+		}
+		std::vector<std::string_view> replays(argv + a + 1, argv + argc);
+		return run_benchmarks(exe, repetitions, argv[a], replays)
+		           ? EXIT_SUCCESS
+		           : EXIT_FAILURE;
+	}
+	if(argc >= 2 && std::string_view{argv[1]} == "compare")
+	{
+		double threshold = DEFAULT_THRESHOLD;
+		int a = 2;
+		if(a + 1 < argc && std::string_view{argv[a]} == "--threshold")
+		{
+			threshold = std::strtod(argv[a + 1], nullptr);
+			a += 2;
+		}
+		if(argc - a != 2)
+		{
+			std::cerr << exe << ": Expected BASE and HEAD.\n";
+			print_usage(exe);
+			return EXIT_FAILURE;
+		}
+		return compare_runs(exe, threshold, argv[a], argv[a + 1])
+		           ? EXIT_SUCCESS
+		           : EXIT_FAILURE;
+	}
+	print_usage(exe);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "bench_store.hpp"
+
+#include <array>
+#include <cmath> // std::sqrt
+#include <cstdio> // std::snprintf
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#ifndef _WIN32
+#include <sys/utsname.h>
+#endif // _WIN32
+
+#include "hash.hpp"
+
+namespace
+{
+
+constexpr std::string_view MAGIC = "erp-bench\t1";
+
+// Two-sided 95% quantiles of Student's t distribution, by degrees of freedom.
+constexpr std::array<double, 30U> T_95{
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+auto t_95(double df) noexcept -> double
+{
+	// NOTE: Fractional degrees of freedom (from Welch) are rounded down,
+	// which widens the interval slightly.
+	if(df < 1.0)
+		return T_95[0];
+	if(df < static_cast<double>(T_95.size() + 1U))
+		return T_95[static_cast<size_t>(df) - 1U];
+	// Cornish-Fisher expansion around the normal quantile.
+	constexpr double Z = 1.959964;
+	constexpr double Z3 = Z * Z * Z;
+	constexpr double Z5 = Z3 * Z * Z;
+	return Z + ((Z3 + Z) / (4.0 * df)) +
+	       (((5.0 * Z5) + (16.0 * Z3) + (3.0 * Z)) / (96.0 * df * df));
+}
+
+struct Moments
+{
+	double n;
+	double mean;
+	double variance; // Of the samples, not the mean.
+};
+
+auto moments(std::vector<double> const& samples) noexcept -> Moments
+{
+	Moments m{static_cast<double>(samples.size()), 0.0, 0.0};
+	if(samples.empty())
+		return m;
+	for(auto const s : samples)
+		m.mean += s;
+	m.mean /= m.n;
+	if(samples.size() < 2U)
+		return m;
+	for(auto const s : samples)
+		m.variance += (s - m.mean) * (s - m.mean);
+	m.variance /= m.n - 1.0;
+	return m;
+}
+
+auto cpu_model() noexcept -> std::string
+{
+	std::ifstream f{"/proc/cpuinfo"};
+	std::string line;
+	while(std::getline(f, line))
+	{
+		if(line.rfind("model name", 0U) != 0U)
+			continue;
+		auto const colon = line.find(':');
+		if(colon == std::string::npos)
+			break;
+		return line.substr(line.find_first_not_of(' ', colon + 1U));
+	}
+	return "unknown CPU";
+}
+
+} // namespace
+
+auto describe_build_and_host() noexcept -> BenchRun
+{
+	BenchRun run{};
+#if defined(__clang__)
+	run.compiler = "Clang " __clang_version__;
+#elif defined(__GNUC__)
+	run.compiler = "GCC " __VERSION__;
+#elif defined(_MSC_VER)
+	run.compiler = "MSVC " + std::to_string(_MSC_FULL_VER);
+#else
+	run.compiler = "unknown compiler";
+#endif
+#ifdef __OPTIMIZE__
+	run.compiler += ", optimized";
+#endif // __OPTIMIZE__
+#ifdef NDEBUG
+	run.compiler += ", NDEBUG";
+#endif // NDEBUG
+#ifndef _WIN32
+	if(struct utsname u{}; uname(&u) == 0)
+	{
+		run.host += u.sysname;
+		run.host += ' ';
+		run.host += u.release;
+		run.host += ' ';
+		run.host += u.machine;
+		run.host += ", ";
+	}
+#endif // _WIN32
+	run.host += cpu_model();
+	run.host += ", ";
+	run.host += std::to_string(std::thread::hardware_concurrency());
+	run.host += " threads";
+	std::array<char, 17U> hex{};
+	std::snprintf(hex.data(), hex.size(), "%016llx",
+	              static_cast<unsigned long long>(content_hash(run.host)));
+	run.fingerprint = hex.data();
+	return run;
+}
+
+auto write_bench_run(std::string_view exe, std::string_view path,
+                     BenchRun const& run) noexcept -> bool
+{
+	std::ofstream f{std::string{path}};
+	f << MAGIC << '\n';
+	f << "commit\t" << run.commit << '\n';
+	f << "compiler\t" << run.compiler << '\n';
+	f << "host\t" << run.host << '\n';
+	f << "fingerprint\t" << run.fingerprint << '\n';
+	f.precision(17);
+	for(auto const& [name, samples] : run.samples)
+		for(auto const s : samples)
+			f << "sample\t" << name << '\t' << s << '\n';
+	if(!f)
+	{
+		std::cerr << exe << ": Could not write benchmark results '" << path
+				  << "'.\n";
+		return false;
+	}
+	return true;
+}
+
+auto read_bench_run(std::string_view exe, std::string_view path) noexcept
+	-> std::optional<BenchRun>
+{
+	std::ifstream f{std::string{path}};
+	if(!f.is_open())
+	{
+		std::cerr << exe << ": Could not open file '" << path << "'.\n";
+		return std::nullopt;
+	}
+	std::string line;
+	if(!std::getline(f, line) || line != MAGIC)
+	{
+		std::cerr << exe << ": '" << path << "' is not a benchmark result.\n";
+		return std::nullopt;
+	}
+	BenchRun run{};
+	while(std::getline(f, line))
+	{
+		auto const tab = line.find('\t');
+		if(tab == std::string::npos)
+			continue;
+		auto const key = std::string_view{line}.substr(0U, tab);
+		auto value = line.substr(tab + 1U);
+		if(key == "commit")
+			run.commit = std::move(value);
+		else if(key == "compiler")
+			run.compiler = std::move(value);
+		else if(key == "host")
+			run.host = std::move(value);
+		else if(key == "fingerprint")
+			run.fingerprint = std::move(value);
+		else if(key == "sample")
+		{
+			auto const name_end = value.rfind('\t');
+			if(name_end == std::string::npos)
+				continue;
+			std::istringstream ss{value.substr(name_end + 1U)};
+			double s{};
+			if(ss >> s)
+				run.samples[value.substr(0U, name_end)].push_back(s);
+		}
+		// NOTE: Unknown keys are skipped, for newer versions of the format.
+	}
+	return run;
+}
+
+auto sample_stats(std::vector<double> const& samples) noexcept -> SampleStats
+{
+	auto const m = moments(samples);
+	if(m.n < 2.0)
+		return {m.mean, 0.0};
+	return {m.mean, t_95(m.n - 1.0) * std::sqrt(m.variance / m.n)};
+}
+
+auto compare_bench_runs(BenchRun const& base, BenchRun const& head) noexcept
+	-> BenchComparison
+{
+	BenchComparison cmp;
+	for(auto const& [name, head_samples] : head.samples)
+	{
+		if(base.samples.count(name) == 0U)
+			cmp.missing_in_base.push_back(name);
+	}
+	auto& deltas = cmp.deltas;
+	for(auto const& [name, base_samples] : base.samples)
+	{
+		auto const it = head.samples.find(name);
+		if(it == head.samples.end() || it->second.size() < 2U)
+		{
+			cmp.missing_in_head.push_back(name);
+			continue;
+		}
+		auto const b = moments(base_samples);
+		auto const h = moments(it->second);
+		if(base_samples.size() < 2U || b.mean <= 0.0)
+		{
+			cmp.uncomparable.push_back(name);
+			continue;
+		}
+		auto const vb = b.variance / b.n;
+		auto const vh = h.variance / h.n;
+		auto const se = std::sqrt(vb + vh);
+		// Welch-Satterthwaite, falling back to the pooled count when both
+		// runs have no spread at all.
+		auto const df = vb + vh > 0.0 ? ((vb + vh) * (vb + vh)) /
+		                                    (((vb * vb) / (b.n - 1.0)) +
+		                                     ((vh * vh) / (h.n - 1.0)))
+		                              : b.n + h.n - 2.0;
+		auto& d = deltas.emplace_back();
+		d.name = name;
+		d.base = sample_stats(base_samples);
+		d.head = sample_stats(it->second);
+		d.change = (h.mean - b.mean) / b.mean;
+		d.margin = (t_95(df) * se) / b.mean;
+		d.significant = d.change - d.margin > 0.0 || d.change + d.margin < 0.0;
+	}
+	return cmp;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_BENCH_STORE_HPP
+#define ERP_BENCH_STORE_HPP
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Results of one `erp-bench run`, along with what they were measured on.
+struct BenchRun
+{
+	std::string commit;
+	std::string compiler;
+	std::string host;        // Kernel, machine, CPU model and thread count.
+	std::string fingerprint; // Hash of `host`, to tell runs apart quickly.
+	// Nanoseconds per iteration, one sample per repetition, by benchmark.
+	std::map<std::string, std::vector<double>> samples;
+};
+
+// Fills every field of `BenchRun` but `commit` and `samples`.
+auto describe_build_and_host() noexcept -> BenchRun;
+
+// Tab separated, one "key<TAB>value" record per line, with one "sample"
+// record per repetition so the spread can be recomputed later.
+auto write_bench_run(std::string_view exe, std::string_view path,
+                     BenchRun const& run) noexcept -> bool;
+
+auto read_bench_run(std::string_view exe, std::string_view path) noexcept
+	-> std::optional<BenchRun>;
+
+struct SampleStats
+{
+	double mean;
+	double margin; // Half width of the 95% confidence interval of the mean.
+};
+
+auto sample_stats(std::vector<double> const& samples) noexcept -> SampleStats;
+
+struct BenchDelta
+{
+	std::string name;
+	SampleStats base;
+	SampleStats head;
+	// Relative change of the mean, with the half width of its 95% confidence
+	// interval (Welch), both as fractions of the base mean.
+	double change;
+	double margin;
+	bool significant; // The interval doesn't contain 0.
+};
+
+struct BenchComparison
+{
+	// Benchmarks that are in both runs and have at least 2 samples each.
+	std::vector<BenchDelta> deltas;
+	// In base but not in head, or with fewer than 2 samples there, so a
+	// regression in them would go unnoticed.
+	std::vector<std::string> missing_in_head;
+	std::vector<std::string> missing_in_base; // New benchmarks.
+	// In both, but with fewer than 2 samples (or a zero mean) in base.
+	std::vector<std::string> uncomparable;
+};
+
+auto compare_bench_runs(BenchRun const& base, BenchRun const& head) noexcept
+	-> BenchComparison;
+
+#endif // ERP_BENCH_STORE_HPP
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_BOARD_STATS_HPP
+#define ERP_BOARD_STATS_HPP
+#include <array>
+#include <cstdint>
+
+// Numeric summary of the board at some point of the duel. Arrays are indexed
+// by controller.
+struct BoardStats
+{
+	uint32_t turn;
+	uint32_t turn_controller;
+	uint32_t phase;
+	uint32_t chain_size;
+	std::array<uint32_t, 2U> lp;
+	std::array<uint32_t, 2U> main_deck;
+	std::array<uint32_t, 2U> hand;
+	std::array<uint32_t, 2U> extra_deck;
+	std::array<uint32_t, 2U> graveyard;
+	std::array<uint32_t, 2U> banished;
+	std::array<uint32_t, 2U> monster_zones; // Bitmask of occupied zones.
+	std::array<uint32_t, 2U> spell_zones;   // Bitmask of occupied zones.
+};
+
+#endif // ERP_BOARD_STATS_HPP
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "card_db.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring> // std::memcpy, std::memcmp
+#include <fstream>
+#include <iostream>
+#include <sqlite3.h>
+#include <string>
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include "hash.hpp"
+
+namespace
+{
+
+// Compiled table layout (native endianness, everything 4-byte aligned):
+//   CompiledHeader
+//   uint32_t displacements[bucket_count]
+//   Slot     slots[slot_count]
+//   char     strings[strings_size]
+// A card is found by hashing its code into a bucket, then hashing it again
+// with that bucket's displacement into its slot. Empty slots have code 0,
+// which is never a valid card code.
+
+constexpr std::array<char, 8U> MAGIC{'E', 'R', 'P', 'C', 'D', 'B', '0', '1'};
+constexpr std::string_view SQLITE_MAGIC{"SQLite format 3\0", 16U};
+constexpr uint32_t MAX_DISPLACEMENT = 1U << 24U;
+
+struct CompiledHeader
+{
+	std::array<char, 8U> magic;
+	uint32_t count;
+	uint32_t bucket_count;
+	uint32_t slot_count;
+	uint32_t strings_size;
+};
+
+struct Slot
+{
+	uint32_t code;
+	uint32_t name_offset;
+	uint32_t name_size;
+	uint32_t type;
+	uint32_t attribute;
+};
+
+constexpr auto hash(uint32_t code, uint32_t seed) noexcept -> uint32_t
+{
+	// NOTE: Mixed with the seed beforehand.
+	return mix32(code ^ (seed * 0x9E3779B9U));
+}
+
+constexpr auto reduce(uint32_t h, uint32_t n) noexcept -> uint32_t
+{
+	return static_cast<uint32_t>((uint64_t{h} * n) >> 32U);
+}
+
+struct Row
+{
+	uint32_t code;
+	uint32_t type;
+	uint32_t attribute;
+	std::string name;
+};
+
+auto read_rows(std::string_view exe,
+               std::string const& cdb_path) noexcept -> std::vector<Row>
+{
+	std::vector<Row> rows;
+	sqlite3* db = nullptr;
+	if(sqlite3_open_v2(cdb_path.data(), &db, SQLITE_OPEN_READONLY, nullptr) !=
+	   SQLITE_OK)
+	{
+		std::cerr << exe << ": Could not open card database '" << cdb_path
+				  << "': " << sqlite3_errmsg(db) << ".\n";
+		sqlite3_close(db);
+		return rows;
+	}
+	struct End
+	{
+		sqlite3* db;
+		sqlite3_stmt* stmt;
+		~End()
+		{
+			sqlite3_finalize(stmt);
+			sqlite3_close(db);
+		}
+	} _{db, nullptr};
+	constexpr auto QUERY =
+		"SELECT datas.id, datas.type, datas.attribute, texts.name "
+		"FROM datas JOIN texts ON texts.id = datas.id;";
+	if(sqlite3_prepare_v2(db, QUERY, -1, &_.stmt, nullptr) != SQLITE_OK)
+	{
+		std::cerr << exe << ": Could not query card database: "
+				  << sqlite3_errmsg(db) << ".\n";
+		return rows;
+	}
+	int step{};
+	while((step = sqlite3_step(_.stmt)) == SQLITE_ROW)
+	{
+		auto& row = rows.emplace_back();
+		row.code = static_cast<uint32_t>(sqlite3_column_int64(_.stmt, 0));
+		row.type = static_cast<uint32_t>(sqlite3_column_int64(_.stmt, 1));
+		row.attribute = static_cast<uint32_t>(sqlite3_column_int64(_.stmt, 2));
+		if(auto const* name = sqlite3_column_text(_.stmt, 3); name != nullptr)
+			row.name = reinterpret_cast<char const*>(name);
+	}
+	if(step != SQLITE_DONE)
+	{
+		std::cerr << exe << ": Error reading card database: "
+				  << sqlite3_errmsg(db) << ".\n";
+		rows.clear();
+	}
+	return rows;
+}
+
+auto build_table(std::string_view exe,
+                 std::string const& cdb_path) noexcept -> std::vector<uint8_t>
+{
+	auto rows = read_rows(exe, cdb_path);
+	std::sort(rows.begin(), rows.end(),
+	          [](Row const& a, Row const& b) { return a.code < b.code; });
+	rows.erase(std::unique(rows.begin(), rows.end(),
+	                       [](Row const& a, Row const& b)
+	                       { return a.code == b.code; }),
+	           rows.end());
+	rows.erase(std::remove_if(rows.begin(), rows.end(),
+	                          [](Row const& r) { return r.code == 0U; }),
+	           rows.end());
+	if(rows.empty())
+	{
+		std::cerr << exe << ": Card database has no cards.\n";
+		return {};
+	}
+	auto const count = static_cast<uint32_t>(rows.size());
+	CompiledHeader header{MAGIC, count, (count / 4U) + 1U,
+	                      count + (count / 4U) + 1U, 0U};
+	// Distribute the codes into buckets, then place the biggest buckets first
+	// as those are the hardest to find a free displacement for.
+	std::vector<std::vector<uint32_t>> buckets(header.bucket_count);
+	for(uint32_t i = 0U; i < count; i++)
+		buckets[reduce(hash(rows[i].code, 0U), header.bucket_count)]
+			.emplace_back(i);
+	std::vector<uint32_t> order(header.bucket_count);
+	for(uint32_t i = 0U; i < header.bucket_count; i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(),
+	                 [&](uint32_t a, uint32_t b)
+	                 { return buckets[a].size() > buckets[b].size(); });
+	std::vector<uint32_t> displacements(header.bucket_count, 0U);
+	std::vector<Slot> slots(header.slot_count, Slot{});
+	std::vector<uint32_t> candidate;
+	for(auto const b : order)
+	{
+		auto const& bucket = buckets[b];
+		if(bucket.empty())
+			break;
+		uint32_t d = 1U;
+		for(; d != MAX_DISPLACEMENT; d++)
+		{
+			candidate.clear();
+			for(auto const i : bucket)
+			{
+				auto const s = reduce(hash(rows[i].code, d), header.slot_count);
+				if(slots[s].code != 0U || std::find(candidate.begin(),
+				                                    candidate.end(),
+				                                    s) != candidate.end())
+					break;
+				candidate.emplace_back(s);
+			}
+			if(candidate.size() == bucket.size())
+				break;
+		}
+		if(d == MAX_DISPLACEMENT)
+		{
+			std::cerr << exe << ": Could not build card table.\n";
+			return {};
+		}
+		displacements[b] = d;
+		for(size_t j = 0U; j < bucket.size(); j++)
+		{
+			auto const& row = rows[bucket[j]];
+			slots[candidate[j]] = {row.code, header.strings_size,
+			                       static_cast<uint32_t>(row.name.size()),
+			                       row.type, row.attribute};
+			header.strings_size += static_cast<uint32_t>(row.name.size());
+		}
+	}
+	std::vector<uint8_t> out(sizeof(CompiledHeader) +
+	                         (displacements.size() * sizeof(uint32_t)) +
+	                         (slots.size() * sizeof(Slot)) +
+	                         header.strings_size);
+	auto* ptr = out.data();
+	auto write = [&ptr](void const* data, size_t size)
+	{
+		std::memcpy(ptr, data, size);
+		ptr += size;
+	};
+	write(&header, sizeof(CompiledHeader));
+	write(displacements.data(), displacements.size() * sizeof(uint32_t));
+	write(slots.data(), slots.size() * sizeof(Slot));
+	// NOTE: Names are laid out in the same order their offsets were assigned.
+	for(auto const b : order)
+		for(auto const i : buckets[b])
+			write(rows[i].name.data(), rows[i].name.size());
+	return out;
+}
+
+} // namespace
+
+auto compile_card_db(std::string_view exe, std::string_view cdb_path,
+                     std::string_view out_path) noexcept -> bool
+{
+	auto const table = build_table(exe, std::string{cdb_path});
+	if(table.empty())
+		return false; // NOTE: Error printed by `build_table`.
+	std::ofstream f(std::string{out_path},
+	                std::ios_base::binary | std::ios_base::out);
+	f.write(reinterpret_cast<char const*>(table.data()), table.size());
+	if(!f)
+	{
+		std::cerr << exe << ": Could not write card table '" << out_path
+				  << "'.\n";
+		return false;
+	}
+	return true;
+}
+
+CardDb::~CardDb() noexcept
+{
+#ifndef _WIN32
+	if(map_ != nullptr)
+		munmap(map_, map_size_);
+#endif // _WIN32
+}
+
+auto CardDb::open(std::string_view exe, std::string_view path) noexcept -> bool
+{
+	std::string const fn{path};
+	std::array<char, SQLITE_MAGIC.size()> magic{};
+	{
+		std::ifstream f(fn, std::ios_base::binary | std::ios_base::in);
+		if(!f.is_open())
+		{
+			std::cerr << exe << ": Could not open file '" << path << "'.\n";
+			return false;
+		}
+		f.read(magic.data(), magic.size());
+	}
+	if(std::string_view{magic.data(), magic.size()} == SQLITE_MAGIC)
+	{
+		owned_ = build_table(exe, fn);
+		return !owned_.empty() && attach(exe, owned_.data(), owned_.size());
+	}
+#ifdef _WIN32
+	std::ifstream f(fn, std::ios_base::binary | std::ios_base::in);
+	owned_.assign(std::istreambuf_iterator<char>(f),
+	              std::istreambuf_iterator<char>());
+	return attach(exe, owned_.data(), owned_.size());
+#else
+	int const fd = ::open(fn.data(), O_RDONLY);
+	struct stat st{};
+	if(fd == -1 || fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		std::cerr << exe << ": Could not open file '" << path << "'.\n";
+		if(fd != -1)
+			close(fd);
+		return false;
+	}
+	map_size_ = static_cast<size_t>(st.st_size);
+	map_ = mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map_ == MAP_FAILED)
+	{
+		map_ = nullptr;
+		std::cerr << exe << ": Could not map file '" << path << "'.\n";
+		return false;
+	}
+	return attach(exe, static_cast<uint8_t const*>(map_), map_size_);
+#endif // _WIN32
+}
+
+auto CardDb::find(uint32_t code) const noexcept -> std::optional<CardInfo>
+{
+	if(slots_ == nullptr || code == 0U)
+		return std::nullopt;
+	uint32_t d{};
+	std::memcpy(&d,
+	            displacements_ + reduce(hash(code, 0U), bucket_count_),
+	            sizeof(d));
+	Slot s{};
+	std::memcpy(&s, slots_ + (reduce(hash(code, d), slot_count_) * sizeof(Slot)),
+	            sizeof(Slot));
+	if(s.code != code || s.name_offset > strings_size_ ||
+	   s.name_size > strings_size_ - s.name_offset)
+		return std::nullopt;
+	return CardInfo{{strings_ + s.name_offset, s.name_size}, s.type,
+	                s.attribute};
+}
+
+auto CardDb::attach(std::string_view exe, uint8_t const* data,
+                    size_t size) noexcept -> bool
+{
+	CompiledHeader header{};
+	if(size >= sizeof(CompiledHeader))
+		std::memcpy(&header, data, sizeof(CompiledHeader));
+	if(size < sizeof(CompiledHeader) || header.magic != MAGIC ||
+	   header.bucket_count == 0U || header.slot_count == 0U ||
+	   size != sizeof(CompiledHeader) +
+	               (uint64_t{header.bucket_count} * sizeof(uint32_t)) +
+	               (uint64_t{header.slot_count} * sizeof(Slot)) +
+	               header.strings_size)
+	{
+		std::cerr << exe << ": Not a card database or card table.\n";
+		return false;
+	}
+	bucket_count_ = header.bucket_count;
+	slot_count_ = header.slot_count;
+	strings_size_ = header.strings_size;
+	data += sizeof(CompiledHeader);
+	displacements_ = reinterpret_cast<uint32_t const*>(data);
+	data += bucket_count_ * sizeof(uint32_t);
+	slots_ = data;
+	data += slot_count_ * sizeof(Slot);
+	strings_ = reinterpret_cast<char const*>(data);
+	return true;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_CARD_DB_HPP
+#define ERP_CARD_DB_HPP
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+struct CardInfo
+{
+	std::string_view name;
+	uint32_t type;
+	uint32_t attribute;
+};
+
+// Compiles the `datas` and `texts` tables of a SQLite card database into the
+// memory-mappable table that `CardDb` reads. Returns false on error.
+auto compile_card_db(std::string_view exe, std::string_view cdb_path,
+                     std::string_view out_path) noexcept -> bool;
+
+// Read-only card table, looked up through a perfect (not minimal) hash keyed
+// by card code, with about 1.25 slots per card. Accepts either a compiled
+// table (which is memory-mapped) or a SQLite card database directly (which is
+// compiled in memory first).
+class CardDb final
+{
+public:
+	CardDb() noexcept = default;
+	CardDb(CardDb const&) = delete;
+	CardDb& operator=(CardDb const&) = delete;
+	~CardDb() noexcept;
+
+	auto open(std::string_view exe, std::string_view path) noexcept -> bool;
+
+	auto find(uint32_t code) const noexcept -> std::optional<CardInfo>;
+
+private:
+	auto attach(std::string_view exe, uint8_t const* data,
+	            size_t size) noexcept -> bool;
+
+	std::vector<uint8_t> owned_;
+	void* map_{};
+	size_t map_size_{};
+	uint32_t bucket_count_{};
+	uint32_t slot_count_{};
+	uint32_t strings_size_{};
+	uint32_t const* displacements_{};
+	uint8_t const* slots_{};
+	char const* strings_{};
+};
+
+#endif // ERP_CARD_DB_HPP
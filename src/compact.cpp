@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "compact.hpp"
+
+#include <cstring> // std::memcmp
+#include <filesystem>
+#include <iostream>
+#include <lzma.h>
+#include <string>
+#include <system_error>
+
+#include "framing.hpp"
+#include "parallel.hpp"
+#include "parser.hpp"
+#include "recompress.hpp"
+#include "replay_file.hpp"
+
+namespace
+{
+
+constexpr uint32_t PRESET = 9U | LZMA_PRESET_EXTREME;
+
+struct CompactResult
+{
+	bool success;
+	uintmax_t size_before;
+	uintmax_t size_after;
+	size_t dropped;
+};
+
+auto messages_offset(LoadReplayResult& replay) noexcept
+	-> std::optional<size_t>
+{
+	auto* ptr = replay.buffer.data();
+	auto const* const sentry = ptr + replay.buffer.size();
+	if(!skip_duelists(replay.header.base.flags, ptr, sentry) ||
+	   !read_duel_flags(replay.header.base.flags, ptr, sentry))
+		return std::nullopt;
+	return static_cast<size_t>(ptr - replay.buffer.data());
+}
+
+// Loads and analyzes `fn`, returning its embedded yrp contents too.
+// NOTE: `analyze` mutates the buffer, `pristine` keeps a copy of it.
+struct Analyzed
+{
+	LoadReplayResult replay;
+	std::vector<uint8_t> pristine;
+	AnalyzeResult analysis;
+	LoadOldReplayResult yrp;
+};
+
+auto load_and_analyze(std::string_view exe, std::string_view fn,
+                      bool record_redundant, Analyzed& a) noexcept -> bool
+{
+	a.replay = load_replay(exe, fn);
+	if(!a.replay.success)
+		return false; // NOTE: Error printed by `load_replay`.
+	if(((a.replay.header.base.version >> 16U) & 0xFFU) < 10U)
+	{
+		std::cerr << exe << ": Core version for this replay is too old.\n";
+		return false;
+	}
+	auto const offset = messages_offset(a.replay);
+	if(!offset.has_value())
+	{
+		std::cerr << exe << ": Replay is truncated.\n";
+		return false;
+	}
+	a.pristine = a.replay.buffer;
+	AnalyzeOptions options{};
+	options.record_redundant = record_redundant;
+	a.analysis = analyze(exe, a.replay.buffer.data() + *offset,
+	                     a.replay.buffer.size() - *offset, options);
+	if(!a.analysis.success)
+		return false; // NOTE: Error printed by `analyze`.
+	if(a.analysis.old_replay_mode_buffer == nullptr)
+	{
+		std::cerr << exe << ": Replay doesn't have OLD_REPLAY_MODE.\n";
+		return false;
+	}
+	// NOTE: The embedded yrp is past every message `analyze` mutated.
+	a.yrp = load_old_replay(exe, a.analysis.old_replay_mode_buffer,
+	                        a.analysis.old_replay_mode_size);
+	return a.yrp.success; // NOTE: Error printed by `load_old_replay`.
+}
+
+auto compact(std::string_view exe, std::string_view fn,
+             std::string const& out_path) noexcept -> CompactResult
+{
+	CompactResult r{};
+	Analyzed original{};
+	if(!load_and_analyze(exe, fn, true, original))
+		return r;
+	auto header = original.replay.header;
+	auto const& pristine = original.pristine;
+	// NOTE: Already checked by `load_and_analyze`.
+	auto const offset = *messages_offset(original.replay);
+	// Copy every message but the redundant ones, with the embedded yrp
+	// compressed again.
+	std::vector<uint8_t> contents(pristine.begin(), pristine.begin() + offset);
+	auto const& redundant = original.analysis.redundant_frames;
+	auto next_redundant = redundant.begin();
+	uint8_t const* ptr = pristine.data() + offset;
+	uint8_t const* const sentry = pristine.data() + pristine.size();
+	MessageFrame msg{};
+	for(uint32_t frame = 0U; ptr != sentry; frame++)
+	{
+		auto const* const frame_start = ptr;
+		if(!next_message(exe, ptr, sentry, msg))
+			return r; // NOTE: Error printed by `next_message`.
+		if(next_redundant != redundant.end() && *next_redundant == frame)
+		{
+			++next_redundant;
+			r.dropped++;
+			continue;
+		}
+		// NOTE: An uncompressed embedded yrp is left as is, it compresses
+		// better along with the rest of the messages.
+		if(msg.type != 231U || // NOLINT: OLD_REPLAY_FORMAT
+		   (original.yrp.header.base.flags & REPLAY_COMPRESSED) == 0U)
+		{
+			contents.insert(contents.end(), frame_start, ptr);
+			continue;
+		}
+		auto yrp_header = original.yrp.header;
+		auto const yrp_body =
+			compress_body(exe, yrp_header, original.yrp.buffer,
+		                  original.yrp.size, PRESET);
+		if(yrp_body.empty())
+			return r; // NOTE: Error printed by `compress_body`.
+		auto const yrp = serialize_replay(yrp_header, yrp_body);
+		contents.push_back(msg.type);
+		auto const size = static_cast<uint32_t>(yrp.size());
+		for(unsigned i = 0U; i < sizeof(size); i++)
+			contents.push_back(static_cast<uint8_t>((size >> (8U * i)) & 0xFFU));
+		contents.insert(contents.end(), yrp.begin(), yrp.end());
+	}
+	header.base.flags |= REPLAY_COMPRESSED;
+	auto const body =
+		compress_body(exe, header, contents.data(), contents.size(), PRESET);
+	if(body.empty())
+		return r; // NOTE: Error printed by `compress_body`.
+	auto const tmp_path = out_path + ".tmp";
+	if(!write_file(exe, tmp_path, serialize_replay(header, body)))
+		return r; // NOTE: Error printed by `write_file`.
+	// Verify the output by parsing it again, it must end with the same board
+	// after the same messages (minus the dropped ones), and embed the same
+	// yrp.
+	Analyzed compacted{};
+	auto const verified =
+		load_and_analyze(exe, tmp_path, false, compacted) &&
+		compacted.analysis.message_count + r.dropped ==
+			original.analysis.message_count &&
+		// NOTE: BoardStats is only made of uint32_t, it has no padding.
+		std::memcmp(&compacted.analysis.board, &original.analysis.board,
+	                sizeof(BoardStats)) == 0 &&
+		compacted.yrp.size == original.yrp.size &&
+		std::memcmp(compacted.yrp.buffer, original.yrp.buffer,
+	                original.yrp.size) == 0;
+	std::error_code ec;
+	if(!verified)
+	{
+		std::cerr << exe << ": Compacted replay does not match original.\n";
+		std::filesystem::remove(tmp_path, ec);
+		return r;
+	}
+	std::filesystem::rename(tmp_path, out_path, ec);
+	if(ec)
+	{
+		std::cerr << exe << ": Could not write file '" << out_path << "'.\n";
+		return r;
+	}
+	r.size_before = std::filesystem::file_size(std::string{fn}, ec);
+	r.size_after = std::filesystem::file_size(out_path, ec);
+	r.success = true;
+	return r;
+}
+
+} // namespace
+
+auto compact_replays(std::string_view exe, std::ostream& out,
+                     std::string_view out_dir,
+                     std::vector<std::string_view> const& replays,
+                     unsigned jobs) noexcept -> bool
+{
+	bool all_success = true;
+	parallel_ordered(
+		replays.size(), jobs,
+		[&](size_t i) -> CompactResult
+		{
+			auto const fn = replays[i];
+			auto const prefixed_exe = std::string{exe} + ": " + std::string{fn};
+			auto const out_path =
+				std::filesystem::path{out_dir} /
+				std::filesystem::path{fn}.filename();
+			std::error_code ec;
+			if(std::filesystem::equivalent(fn, out_path, ec))
+			{
+				std::cerr << prefixed_exe << ": Refusing to overwrite the "
+				          << "original replay.\n";
+				return {};
+			}
+			return compact(prefixed_exe, fn, out_path.string());
+		},
+		[&](size_t i, CompactResult r)
+		{
+			all_success = all_success && r.success;
+			if(r.success)
+				out << replays[i] << ": " << r.size_before << " -> "
+					<< r.size_after << " bytes, " << r.dropped
+					<< " messages dropped\n";
+		});
+	return all_success;
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_COMPACT_HPP
+#define ERP_COMPACT_HPP
+#include <iosfwd>
+#include <string_view>
+#include <vector>
+
+// Writes each replay to `out_dir`, under the same file name, without the
+// messages whose queries change nothing and with both the yrpX and its
+// embedded yrp compressed with the strongest LZMA settings. Every output is
+// parsed again and compared against its original before being kept. Prints
+// the sizes before and after of each replay to `out`. Up to `jobs` replays
+// are rewritten in parallel. Returns false if any replay failed.
+auto compact_replays(std::string_view exe, std::ostream& out,
+                     std::string_view out_dir,
+                     std::vector<std::string_view> const& replays,
+                     unsigned jobs) noexcept -> bool;
+
+#endif // ERP_COMPACT_HPP
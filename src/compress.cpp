@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "compress.hpp"
+
+#include <climits> // UINT_MAX
+#include <cstdlib> // std::strtol
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <zlib.h>
+#ifdef ERP_HAVE_ZSTD
+#include <zstd.h>
+#endif // ERP_HAVE_ZSTD
+
+namespace
+{
+
+auto compress_gzip(std::string_view exe, int level, std::string_view in,
+                   std::string& out) noexcept -> bool
+{
+	// NOTE: A single deflate call is used, which takes 32 bit sizes.
+	if(in.size() > UINT_MAX)
+	{
+		std::cerr << exe << ": Output too big to compress.\n";
+		return false;
+	}
+	z_stream s{};
+	// NOTE: 16 added to the window bits asks zlib for a gzip wrapper.
+	if(deflateInit2(&s, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) !=
+	   Z_OK)
+	{
+		std::cerr << exe << ": Could not initialize gzip stream.\n";
+		return false;
+	}
+	out.resize(deflateBound(&s, static_cast<uLong>(in.size())));
+	s.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+	s.avail_in = static_cast<uInt>(in.size());
+	s.next_out = reinterpret_cast<Bytef*>(out.data());
+	s.avail_out = static_cast<uInt>(out.size());
+	auto const r = deflate(&s, Z_FINISH);
+	out.resize(s.total_out);
+	deflateEnd(&s);
+	if(r != Z_STREAM_END)
+	{
+		std::cerr << exe << ": Error compressing output.\n";
+		return false;
+	}
+	return true;
+}
+
+#ifdef ERP_HAVE_ZSTD
+auto compress_zstd(std::string_view exe, int level, ZSTD_CDict const* cdict,
+                   std::string_view in, std::string& out) noexcept -> bool
+{
+	struct FreeCCtx
+	{
+		auto operator()(ZSTD_CCtx* cctx) const noexcept -> void
+		{
+			ZSTD_freeCCtx(cctx);
+		}
+	};
+	// NOTE: Contexts are reused by each worker, creating them is expensive.
+	thread_local std::unique_ptr<ZSTD_CCtx, FreeCCtx> cctx(ZSTD_createCCtx());
+	if(!cctx)
+	{
+		std::cerr << exe << ": Could not initialize zstd context.\n";
+		return false;
+	}
+	out.resize(ZSTD_compressBound(in.size()));
+	auto const r =
+		cdict != nullptr
+			? ZSTD_compress_usingCDict(cctx.get(), out.data(), out.size(),
+		                               in.data(), in.size(), cdict)
+			: ZSTD_compressCCtx(cctx.get(), out.data(), out.size(), in.data(),
+		                        in.size(), level);
+	if(ZSTD_isError(r) != 0U)
+	{
+		std::cerr << exe << ": Error compressing output: "
+				  << ZSTD_getErrorName(r) << ".\n";
+		return false;
+	}
+	out.resize(r);
+	return true;
+}
+#endif // ERP_HAVE_ZSTD
+
+} // namespace
+
+OutputCompressor::~OutputCompressor() noexcept
+{
+#ifdef ERP_HAVE_ZSTD
+	ZSTD_freeCDict(static_cast<ZSTD_CDict*>(cdict_));
+#endif // ERP_HAVE_ZSTD
+}
+
+auto OutputCompressor::open(std::string_view exe, std::string_view spec,
+                            std::string_view dict_path) noexcept -> bool
+{
+	auto const colon = spec.find(':');
+	auto const name = spec.substr(0U, colon);
+	std::optional<int> level;
+	if(colon != std::string_view::npos)
+	{
+		std::string const s{spec.substr(colon + 1U)};
+		char* end = nullptr;
+		level = static_cast<int>(std::strtol(s.data(), &end, 10));
+		if(s.empty() || *end != '\0')
+		{
+			std::cerr << exe << ": Invalid compression level '" << s << "'.\n";
+			return false;
+		}
+	}
+	if(name == "gzip")
+	{
+		if(level.value_or(0) < 0 || level.value_or(0) > 9)
+		{
+			std::cerr << exe << ": Gzip level must be between 0 and 9.\n";
+			return false;
+		}
+		if(!dict_path.empty())
+		{
+			std::cerr << exe << ": Dictionaries are only supported by zstd.\n";
+			return false;
+		}
+		codec_ = Codec::GZIP;
+		level_ = level.value_or(Z_DEFAULT_COMPRESSION);
+		return true;
+	}
+	if(name != "zstd")
+	{
+		std::cerr << exe << ": Unknown compression '" << name << "'.\n";
+		return false;
+	}
+#ifdef ERP_HAVE_ZSTD
+	level_ = level.value_or(ZSTD_CLEVEL_DEFAULT);
+	if(level_ < ZSTD_minCLevel() || level_ > ZSTD_maxCLevel())
+	{
+		std::cerr << exe << ": Zstd level must be between " << ZSTD_minCLevel()
+				  << " and " << ZSTD_maxCLevel() << ".\n";
+		return false;
+	}
+	if(!dict_path.empty())
+	{
+		std::ifstream f(std::string{dict_path},
+		                std::ios_base::binary | std::ios_base::in);
+		if(!f.is_open())
+		{
+			std::cerr << exe << ": Could not open file '" << dict_path
+					  << "'.\n";
+			return false;
+		}
+		std::vector<char> const dict(std::istreambuf_iterator<char>(f),
+		                             std::istreambuf_iterator<char>{});
+		// NOTE: Digested once and shared by all workers, it is read-only.
+		cdict_ = ZSTD_createCDict(dict.data(), dict.size(), level_);
+		if(cdict_ == nullptr)
+		{
+			std::cerr << exe << ": Could not load dictionary '" << dict_path
+					  << "'.\n";
+			return false;
+		}
+	}
+	codec_ = Codec::ZSTD;
+	return true;
+#else
+	std::cerr << exe << ": Built without zstd support.\n";
+	return false;
+#endif // ERP_HAVE_ZSTD
+}
+
+auto OutputCompressor::compress(std::string_view exe, std::string_view in,
+                                std::string& out) const noexcept -> bool
+{
+	switch(codec_)
+	{
+	case Codec::GZIP:
+		return compress_gzip(exe, level_, in, out);
+#ifdef ERP_HAVE_ZSTD
+	case Codec::ZSTD:
+		return compress_zstd(exe, level_,
+		                     static_cast<ZSTD_CDict const*>(cdict_), in, out);
+#endif // ERP_HAVE_ZSTD
+	default:
+		out.assign(in);
+		return true;
+	}
+}
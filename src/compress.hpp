@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_COMPRESS_HPP
+#define ERP_COMPRESS_HPP
+#include <string>
+#include <string_view>
+
+// Compresses the output of each replay on its own, as a gzip member or a
+// zstd frame. Both formats allow concatenating those, so the outputs of
+// several replays decompress as a single stream.
+class OutputCompressor final
+{
+public:
+	OutputCompressor() noexcept = default;
+	OutputCompressor(OutputCompressor const&) = delete;
+	OutputCompressor& operator=(OutputCompressor const&) = delete;
+	~OutputCompressor() noexcept;
+
+	// `spec` is "gzip[:LEVEL]" or "zstd[:LEVEL]". A dictionary (as trained
+	// by `zstd --train`) can only be given for zstd.
+	auto open(std::string_view exe, std::string_view spec,
+	          std::string_view dict_path) noexcept -> bool;
+
+	auto enabled() const noexcept -> bool { return codec_ != Codec::NONE; }
+
+	// Thread-safe, each thread keeps its own compression context.
+	auto compress(std::string_view exe, std::string_view in,
+	              std::string& out) const noexcept -> bool;
+
+private:
+	enum class Codec
+	{
+		NONE,
+		GZIP,
+		ZSTD,
+	};
+
+	Codec codec_{Codec::NONE};
+	int level_{};
+	void* cdict_{}; // ZSTD_CDict
+};
+
+#endif // ERP_COMPRESS_HPP
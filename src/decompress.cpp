@@ -5,19 +5,35 @@
  */
 #include "decompress.hpp"
 
+#include <algorithm> // std::max, std::min
 #include <array>
 #include <cstring> // std::memcpy
 #include <iostream>
 #include <lzma.h>
 
+#include "probes.hpp"
+
+namespace
+{
+
+constexpr size_t INITIAL_SIZE = size_t{1U} << 20U;
+
+} // namespace
+
 auto decompress(std::string_view exe, ExtendedReplayHeader const& header,
                 uint8_t const* replay_buffer, size_t replay_buffer_size,
                 size_t max_size) noexcept -> std::vector<uint8_t>
 {
-	std::vector<uint8_t> ret(max_size);
+	ERP_PROBE2(decompress__start, replay_buffer_size, max_size);
+	// NOTE: `max_size` comes from the replay header and can't be trusted, the
+	// output buffer starts at a guess based on the input size and grows as
+	// data is actually decoded, so a tiny file can't claim gigabytes.
+	std::vector<uint8_t> ret(
+		std::min(max_size, std::max(replay_buffer_size * 8U, INITIAL_SIZE)));
 	// Decompress data in LZMA1 format.
 	auto fail = [&](std::string_view e) -> std::vector<uint8_t>&
 	{
+		ERP_PROBE1(decompress__done, size_t{0U});
 		std::cerr << exe << ": Error decompressing replay: " << e << ".\n";
 		ret.clear();
 		return ret;
@@ -41,7 +57,7 @@ auto decompress(std::string_view exe, ExtendedReplayHeader const& header,
 	lzma_stream stream = LZMA_STREAM_INIT;
 	stream.avail_in = fake_header.size();
 	stream.next_in = fake_header.data();
-	stream.avail_out = max_size;
+	stream.avail_out = ret.size();
 	stream.next_out = ret.data();
 	if(lzma_alone_decoder(&stream, UINT64_MAX) != LZMA_OK)
 		return fail("Unable to initialize decode stream");
@@ -57,8 +73,16 @@ auto decompress(std::string_view exe, ExtendedReplayHeader const& header,
 		return fail("Unexpected total decompressed size");
 	stream.avail_in = replay_buffer_size;
 	stream.next_in = replay_buffer;
-	while(stream.avail_in != 0)
+	for(;;)
 	{
+		if(stream.avail_out == 0U)
+		{
+			if(ret.size() == max_size)
+				break;
+			ret.resize(std::min(max_size, ret.size() * 2U));
+			stream.next_out = ret.data() + stream.total_out;
+			stream.avail_out = ret.size() - stream.total_out;
+		}
 		auto const step = lzma_code(&stream, LZMA_RUN);
 		if(step == LZMA_STREAM_END)
 			break;
@@ -68,8 +92,12 @@ auto decompress(std::string_view exe, ExtendedReplayHeader const& header,
 				break; // Ignore error so long the total size matches.
 			return fail("Stream decoding failed");
 		}
+		// NOTE: With room left over, the decoder has nothing pending.
+		if(stream.avail_in == 0U && stream.avail_out != 0U)
+			break;
 	}
 	if(stream.total_out != max_size)
 		return fail("Total decompressed size mismatch");
+	ERP_PROBE1(decompress__done, ret.size());
 	return ret;
 }
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "diff.hpp"
+
+#include <cstring> // std::memcpy
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "framing.hpp"
+#include "parser.hpp"
+#include "replay_file.hpp"
+
+namespace
+{
+
+// Hash of a message chained with the hash of all the messages before it.
+auto hash_message(MessageFrame const& msg, uint64_t prev) noexcept -> uint64_t
+{
+	constexpr uint64_t K1 = 0x9E3779B97F4A7C15U;
+	constexpr uint64_t K2 = 0xC2B2AE3D27D4EB4FU;
+	auto mix = [](uint64_t h, uint64_t v) -> uint64_t
+	{
+		h ^= v * K1;
+		h = (h << 31U) | (h >> 33U);
+		return h * K2;
+	};
+	auto h = mix(prev, (uint64_t{msg.type} << 32U) | msg.size);
+	auto const* ptr = msg.data;
+	auto left = size_t{msg.size};
+	for(; left >= sizeof(uint64_t); left -= sizeof(uint64_t))
+	{
+		uint64_t v{};
+		std::memcpy(&v, ptr, sizeof(v));
+		h = mix(h, v);
+		ptr += sizeof(v);
+	}
+	uint64_t tail{};
+	std::memcpy(&tail, ptr, left);
+	h = mix(h, tail);
+	h ^= h >> 29U;
+	return h;
+}
+
+struct Stream
+{
+	std::string exe;
+	LoadReplayResult replay;
+	uint8_t* msgs{};
+	uint8_t const* ptr{};
+	uint8_t const* sentry{};
+	uint64_t hash{};
+};
+
+auto open_stream(std::string_view exe, std::string_view fn,
+                 Stream& s) noexcept -> void
+{
+	s.exe = std::string{exe} + ": " + std::string{fn};
+	s.replay = load_replay(s.exe, fn);
+	if(!s.replay.success)
+		return; // NOTE: Error printed by `load_replay`.
+	auto* ptr = s.replay.buffer.data();
+	auto const* const sentry = ptr + s.replay.buffer.size();
+	if(!skip_duelists(s.replay.header.base.flags, ptr, sentry) ||
+	   !read_duel_flags(s.replay.header.base.flags, ptr, sentry))
+	{
+		std::cerr << s.exe << ": Replay is truncated.\n";
+		s.replay.success = false;
+		return;
+	}
+	s.msgs = ptr;
+	s.ptr = ptr;
+	s.sentry = s.replay.buffer.data() + s.replay.buffer.size();
+}
+
+// Returns 1 if a message was read, 0 at the end of the messages, -1 on error.
+auto advance(Stream& s, MessageFrame& msg) noexcept -> int
+{
+	if(s.ptr == s.sentry)
+		return 0;
+	if(!next_message(s.exe, s.ptr, s.sentry, msg))
+		return -1;
+	if(msg.type == 231U) // NOLINT: OLD_REPLAY_FORMAT
+	{
+		s.ptr = s.sentry;
+		return 0;
+	}
+	s.hash = hash_message(msg, s.hash);
+	return 1;
+}
+
+auto print_message(std::string_view name, int state,
+                   MessageFrame const& msg) noexcept -> void
+{
+	std::cout << "  " << name << ": ";
+	if(state == 0)
+		std::cout << "end of messages\n";
+	else
+		std::cout << "message type " << uint32_t{msg.type} << ", " << msg.size
+				  << " bytes\n";
+}
+
+} // namespace
+
+auto diff_replays(std::string_view exe, std::string_view fn_a,
+                  std::string_view fn_b) noexcept -> int
+{
+	Stream a;
+	Stream b;
+	{
+		std::thread tb([&]() { open_stream(exe, fn_b, b); });
+		open_stream(exe, fn_a, a);
+		tb.join();
+	}
+	if(!a.replay.success || !b.replay.success)
+		return 2;
+	size_t index = 0U;
+	MessageFrame ma{};
+	MessageFrame mb{};
+	int sa{};
+	int sb{};
+	for(;; index++)
+	{
+		sa = advance(a, ma);
+		sb = advance(b, mb);
+		if(sa < 0 || sb < 0)
+			return 2; // NOTE: Error printed by `next_message`.
+		if(sa == 0 && sb == 0)
+		{
+			std::cout << "Replays have the same " << index << " messages.\n";
+			return 0;
+		}
+		if(sa != sb || a.hash != b.hash)
+			break;
+	}
+	std::cout << "Replays diverge at message " << index << ".\n";
+	print_message("A", sa, ma);
+	print_message("B", sb, mb);
+	if(index == 0U)
+		return 1;
+	// Board context, only the messages before the divergence are encoded.
+	if(((a.replay.header.base.version >> 16U) & 0xFFU) < 10U)
+	{
+		std::cerr << a.exe << ": Core version for this replay is too old.\n";
+		return 1;
+	}
+	AnalyzeOptions options{};
+	options.frame_limit = index;
+	auto const size =
+		a.replay.buffer.size() - (a.msgs - a.replay.buffer.data());
+	auto const analysis = analyze(a.exe, a.msgs, size, options);
+	if(!analysis.success)
+		return 1; // NOTE: Error printed by `analyze`.
+	auto const& s = analysis.board;
+	std::cout << "  Board before it: turn " << s.turn << ", turn player "
+			  << s.turn_controller << ", phase " << s.phase << ", chain "
+			  << s.chain_size << '\n';
+	for(size_t p = 0U; p < 2U; p++)
+		std::cout << "    Player " << p << ": LP " << s.lp[p] << ", hand "
+				  << s.hand[p] << ", deck " << s.main_deck[p] << ", extra "
+				  << s.extra_deck[p] << ", GY " << s.graveyard[p]
+				  << ", banished " << s.banished[p] << '\n';
+	return 1;
+}
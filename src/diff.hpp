@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_DIFF_HPP
+#define ERP_DIFF_HPP
+#include <string_view>
+
+// Compares the duel messages of two yrpX replays and prints where they first
+// diverge, if they do. Returns 0 if they match, 1 if they don't and 2 on
+// error, like diff(1).
+auto diff_replays(std::string_view exe, std::string_view fn_a,
+                  std::string_view fn_b) noexcept -> int;
+
+#endif // ERP_DIFF_HPP
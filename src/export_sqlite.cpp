@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "export_sqlite.hpp"
+
+#include <algorithm> // std::sort
+#include <array>
+#include <atomic>
+#include <cstdio> // std::snprintf
+#include <iostream>
+#include <optional>
+#include <sqlite3.h>
+#include <string>
+
+#include "framing.hpp"
+#include "parallel.hpp"
+#include "print_names.hpp"
+#include "replay_file.hpp"
+
+namespace
+{
+
+// Replays stored per transaction, the rest of the time SQLite only appends
+// to the WAL.
+constexpr size_t REPLAYS_PER_TRANSACTION = 1024U;
+
+constexpr auto SCHEMA =
+	"CREATE TABLE IF NOT EXISTS replays("
+	"id INTEGER PRIMARY KEY, file TEXT NOT NULL, date INTEGER NOT NULL, "
+	"flags INTEGER NOT NULL, version INTEGER NOT NULL, seed TEXT NOT NULL, "
+	"starting_lp INTEGER NOT NULL, starting_draw_count INTEGER NOT NULL, "
+	"draw_count_per_turn INTEGER NOT NULL, duel_flags INTEGER NOT NULL, "
+	"winner INTEGER, win_reason INTEGER, message_count INTEGER NOT NULL);"
+	"CREATE TABLE IF NOT EXISTS duelists("
+	"replay_id INTEGER NOT NULL REFERENCES replays(id), "
+	"position INTEGER NOT NULL, team INTEGER NOT NULL, name TEXT NOT NULL, "
+	"PRIMARY KEY(replay_id, position)) WITHOUT ROWID;"
+	"CREATE TABLE IF NOT EXISTS deck_cards("
+	"replay_id INTEGER NOT NULL REFERENCES replays(id), duelist INTEGER, "
+	"deck TEXT NOT NULL, code INTEGER NOT NULL, copies INTEGER NOT NULL);"
+	"CREATE TABLE IF NOT EXISTS messages("
+	"replay_id INTEGER NOT NULL REFERENCES replays(id), "
+	"idx INTEGER NOT NULL, type INTEGER NOT NULL, data BLOB NOT NULL, "
+	"PRIMARY KEY(replay_id, idx)) WITHOUT ROWID;";
+
+// NOTE: Created after the bulk insert, it is cheaper than keeping them
+// updated row by row.
+constexpr auto INDEXES =
+	"CREATE INDEX IF NOT EXISTS deck_cards_replay ON deck_cards(replay_id);"
+	"CREATE INDEX IF NOT EXISTS deck_cards_code ON deck_cards(code);";
+
+enum Statement
+{
+	INSERT_REPLAY,
+	INSERT_DUELIST,
+	INSERT_DECK_CARD,
+	INSERT_MESSAGE,
+	STATEMENT_COUNT
+};
+
+constexpr std::array<char const*, STATEMENT_COUNT> STATEMENTS{
+	"INSERT INTO replays(file, date, flags, version, seed, starting_lp, "
+	"starting_draw_count, draw_count_per_turn, duel_flags, winner, "
+	"win_reason, message_count) VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
+	"INSERT INTO duelists(replay_id, position, team, name) "
+	"VALUES(?, ?, ?, ?);",
+	"INSERT INTO deck_cards(replay_id, duelist, deck, code, copies) "
+	"VALUES(?, ?, ?, ?, ?);",
+	"INSERT INTO messages(replay_id, idx, type, data) VALUES(?, ?, ?, ?);",
+};
+
+struct StoredMessage
+{
+	uint8_t type;
+	size_t offset; // Into `Record::message_data`.
+	uint32_t size;
+};
+
+// Everything stored for a replay, gathered by the workers so the writer only
+// binds values.
+struct Record
+{
+	bool success{};
+	ExtendedReplayHeader header{};
+	ExtendedReplayHeader yrp_header{};
+	DuelistNames names{};
+	DuelOptions options{};
+	uint64_t duel_flags{};
+	Decks decks;
+	std::optional<std::pair<uint8_t, uint8_t>> win; // Player, reason.
+	size_t message_count{};
+	std::vector<StoredMessage> messages;
+	std::vector<uint8_t> message_data;
+};
+
+auto read_record(std::string_view exe, std::string_view fn,
+                 bool with_messages) noexcept -> Record
+{
+	Record r{};
+	auto replay = load_replay(exe, fn);
+	if(!replay.success)
+		return r; // NOTE: Error printed by `load_replay`.
+	auto const flags = replay.header.base.flags;
+	r.header = replay.header;
+	auto* ptr = replay.buffer.data();
+	uint8_t const* const sentry = ptr + replay.buffer.size();
+	auto names = read_names(flags, ptr, replay.buffer.size());
+	std::optional<uint64_t> duel_flags;
+	if(names.has_value() && skip_duelists(flags, ptr, sentry).has_value())
+		duel_flags = read_duel_flags(flags, ptr, sentry);
+	if(!duel_flags.has_value())
+	{
+		std::cerr << exe << ": Replay is truncated.\n";
+		return r;
+	}
+	r.names = std::move(*names);
+	r.duel_flags = *duel_flags;
+	// NOTE: Messages are only framed, the last MSG_WIN gives the outcome.
+	uint8_t const* cptr = ptr;
+	uint8_t* orm_buffer = nullptr;
+	size_t orm_size = 0U;
+	MessageFrame msg{};
+	while(cptr != sentry)
+	{
+		if(!next_message(exe, cptr, sentry, msg))
+			return r; // NOTE: Error printed by `next_message`.
+		if(msg.type == 231U) // NOLINT: OLD_REPLAY_FORMAT
+		{
+			orm_buffer = const_cast<uint8_t*>(msg.data);
+			orm_size = msg.size;
+			continue;
+		}
+		if(msg.type == 5U && msg.size >= 2U) // NOLINT: MSG_WIN
+			r.win.emplace(msg.data[0], msg.data[1]);
+		if(with_messages)
+		{
+			r.messages.push_back({msg.type, r.message_data.size(), msg.size});
+			r.message_data.insert(r.message_data.end(), msg.data,
+			                      msg.data + msg.size);
+		}
+		r.message_count++;
+	}
+	if(orm_buffer == nullptr)
+	{
+		std::cerr << exe << ": Replay doesn't have OLD_REPLAY_MODE.\n";
+		return r;
+	}
+	auto yrp = load_old_replay(exe, orm_buffer, orm_size);
+	if(!yrp.success)
+		return r; // NOTE: Error printed by `load_old_replay`.
+	r.yrp_header = yrp.header;
+	auto const options =
+		read_duel_options(yrp.header.base.flags, yrp.buffer, yrp.size);
+	auto decks = read_decks(yrp.header.base.flags, yrp.buffer, yrp.size);
+	if(!options.has_value() || !decks.has_value())
+	{
+		std::cerr << exe << ": Yrp is truncated.\n";
+		return r;
+	}
+	r.options = *options;
+	r.decks = std::move(*decks);
+	r.success = true;
+	return r;
+}
+
+auto seed_string(ExtendedReplayHeader const& header) noexcept -> std::string
+{
+	std::array<char, 4U * 16U + 1U> buf{};
+	std::snprintf(buf.data(), buf.size(), "%016llx%016llx%016llx%016llx",
+	              static_cast<unsigned long long>(header.seed[0]),
+	              static_cast<unsigned long long>(header.seed[1]),
+	              static_cast<unsigned long long>(header.seed[2]),
+	              static_cast<unsigned long long>(header.seed[3]));
+	return buf.data();
+}
+
+class Writer final
+{
+public:
+	explicit Writer(std::string_view exe) noexcept : exe_(exe) {}
+	Writer(Writer const&) = delete;
+	Writer& operator=(Writer const&) = delete;
+
+	~Writer() noexcept
+	{
+		for(auto* stmt : stmts_)
+			sqlite3_finalize(stmt);
+		sqlite3_close(db_);
+	}
+
+	auto open(std::string_view path) noexcept -> bool
+	{
+		if(sqlite3_open_v2(std::string{path}.data(), &db_,
+		                   SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+		                   nullptr) != SQLITE_OK)
+		{
+			std::cerr << exe_ << ": Could not open database '" << path
+					  << "': " << sqlite3_errmsg(db_) << ".\n";
+			return false;
+		}
+		if(!exec("PRAGMA journal_mode=WAL;"
+		         "PRAGMA synchronous=NORMAL;") ||
+		   !exec(SCHEMA))
+			return false;
+		for(size_t i = 0U; i < STATEMENT_COUNT; i++)
+		{
+			if(sqlite3_prepare_v3(db_, STATEMENTS[i], -1,
+			                      SQLITE_PREPARE_PERSISTENT, &stmts_[i],
+			                      nullptr) != SQLITE_OK)
+				return error();
+		}
+		return exec("BEGIN;");
+	}
+
+	auto write(std::string_view fn, Record const& r) noexcept -> bool
+	{
+		auto* stmt = stmts_[INSERT_REPLAY];
+		sqlite3_bind_text(stmt, 1, fn.data(), static_cast<int>(fn.size()),
+		                  SQLITE_TRANSIENT);
+		sqlite3_bind_int64(stmt, 2, r.header.base.seed);
+		sqlite3_bind_int64(stmt, 3, r.header.base.flags);
+		sqlite3_bind_int64(stmt, 4, r.header.base.version);
+		auto const seed = seed_string(r.yrp_header);
+		sqlite3_bind_text(stmt, 5, seed.data(), static_cast<int>(seed.size()),
+		                  SQLITE_TRANSIENT);
+		sqlite3_bind_int64(stmt, 6, r.options.starting_lp);
+		sqlite3_bind_int64(stmt, 7, r.options.starting_draw_count);
+		sqlite3_bind_int64(stmt, 8, r.options.draw_count_per_turn);
+		sqlite3_bind_int64(stmt, 9, static_cast<sqlite3_int64>(r.duel_flags));
+		if(r.win.has_value())
+		{
+			sqlite3_bind_int(stmt, 10, r.win->first);
+			sqlite3_bind_int(stmt, 11, r.win->second);
+		}
+		else
+		{
+			sqlite3_bind_null(stmt, 10);
+			sqlite3_bind_null(stmt, 11);
+		}
+		sqlite3_bind_int64(stmt, 12, static_cast<sqlite3_int64>(r.message_count));
+		if(!step(stmt))
+			return false;
+		auto const id = sqlite3_last_insert_rowid(db_);
+		stmt = stmts_[INSERT_DUELIST];
+		for(size_t i = 0U; i < r.names.names.size(); i++)
+		{
+			auto const& name = r.names.names[i];
+			sqlite3_bind_int64(stmt, 1, id);
+			sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(i));
+			sqlite3_bind_int(stmt, 3, i < r.names.team1_count ? 0 : 1);
+			sqlite3_bind_text(stmt, 4, name.data(),
+			                  static_cast<int>(name.size()), SQLITE_STATIC);
+			if(!step(stmt))
+				return false;
+		}
+		for(size_t i = 0U; i < r.decks.duelists.size(); i++)
+		{
+			auto const& d = r.decks.duelists[i];
+			if(!write_cards(id, static_cast<int>(i), "main", d.first) ||
+			   !write_cards(id, static_cast<int>(i), "extra", d.second))
+				return false;
+		}
+		if(!write_cards(id, std::nullopt, "rules", r.decks.extra_cards))
+			return false;
+		stmt = stmts_[INSERT_MESSAGE];
+		for(size_t i = 0U; i < r.messages.size(); i++)
+		{
+			auto const& m = r.messages[i];
+			sqlite3_bind_int64(stmt, 1, id);
+			sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(i));
+			sqlite3_bind_int(stmt, 3, m.type);
+			sqlite3_bind_blob(stmt, 4, r.message_data.data() + m.offset,
+			                  static_cast<int>(m.size), SQLITE_STATIC);
+			if(!step(stmt))
+				return false;
+		}
+		if(++pending_ == REPLAYS_PER_TRANSACTION)
+		{
+			if(!exec("COMMIT;BEGIN;"))
+				return false;
+			committed_ += pending_;
+			pending_ = 0U;
+		}
+		return true;
+	}
+
+	auto finish() noexcept -> bool
+	{
+		return exec("COMMIT;") && exec(INDEXES);
+	}
+
+	// After a failed `write`, drops the replays of the open transaction and
+	// indexes the ones already committed, so what is left is consistent.
+	auto abandon() noexcept -> bool
+	{
+		sqlite3_exec(db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+		return exec(INDEXES);
+	}
+
+	// Replays committed so far.
+	auto committed() const noexcept -> size_t
+	{
+		return committed_;
+	}
+
+private:
+	auto error() noexcept -> bool
+	{
+		std::cerr << exe_ << ": Could not write to database: "
+				  << sqlite3_errmsg(db_) << ".\n";
+		return false;
+	}
+
+	auto exec(char const* sql) noexcept -> bool
+	{
+		return sqlite3_exec(db_, sql, nullptr, nullptr, nullptr) == SQLITE_OK ||
+		       error();
+	}
+
+	auto step(sqlite3_stmt* stmt) noexcept -> bool
+	{
+		bool const ok = sqlite3_step(stmt) == SQLITE_DONE || error();
+		sqlite3_reset(stmt);
+		return ok;
+	}
+
+	// Stores each distinct card of `codes` once, with its number of copies.
+	auto write_cards(sqlite3_int64 id, std::optional<int> duelist,
+	                 char const* deck, CodeVector codes) noexcept -> bool
+	{
+		std::sort(codes.begin(), codes.end());
+		auto* stmt = stmts_[INSERT_DECK_CARD];
+		for(size_t i = 0U; i < codes.size();)
+		{
+			size_t j = i + 1U;
+			while(j < codes.size() && codes[j] == codes[i])
+				j++;
+			sqlite3_bind_int64(stmt, 1, id);
+			if(duelist.has_value())
+				sqlite3_bind_int(stmt, 2, *duelist);
+			else
+				sqlite3_bind_null(stmt, 2);
+			sqlite3_bind_text(stmt, 3, deck, -1, SQLITE_STATIC);
+			sqlite3_bind_int64(stmt, 4, codes[i]);
+			sqlite3_bind_int64(stmt, 5, static_cast<sqlite3_int64>(j - i));
+			if(!step(stmt))
+				return false;
+			i = j;
+		}
+		return true;
+	}
+
+	std::string_view exe_;
+	sqlite3* db_{};
+	std::array<sqlite3_stmt*, STATEMENT_COUNT> stmts_{};
+	size_t pending_{};
+	size_t committed_{};
+};
+
+} // namespace
+
+auto export_sqlite(std::string_view exe, std::string_view db_path,
+                   std::vector<std::string_view> const& replays, unsigned jobs,
+                   bool with_messages) noexcept -> bool
+{
+	Writer writer(exe);
+	if(!writer.open(db_path))
+		return false; // NOTE: Error printed by `Writer::open`.
+	bool db_ok = true;
+	bool all_ok = true;
+	// NOTE: Set once the database fails, workers skip what's left.
+	std::atomic<bool> stopped{false};
+	parallel_ordered(
+		replays.size(), jobs,
+		[&](size_t i) -> Record
+		{
+			if(stopped.load(std::memory_order_relaxed))
+				return {};
+			auto const fn = replays[i];
+			return read_record(std::string{exe} + ": " + std::string{fn}, fn,
+			                   with_messages);
+		},
+		[&](size_t i, Record r)
+		{
+			if(!db_ok)
+				return;
+			if(!r.success)
+			{
+				all_ok = false;
+				return; // NOTE: Error printed by `read_record`.
+			}
+			db_ok = writer.write(replays[i], r);
+			if(!db_ok)
+				stopped.store(true, std::memory_order_relaxed);
+		});
+	if(!db_ok)
+	{
+		writer.abandon();
+		std::cerr << exe << ": Export stopped, '" << db_path
+				  << "' only has " << writer.committed()
+				  << " replays of this run.\n";
+		return false;
+	}
+	return writer.finish() && all_ok;
+}
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_EXPORT_SQLITE_HPP
+#define ERP_EXPORT_SQLITE_HPP
+#include <string_view>
+#include <vector>
+
+// Loads each replay into the SQLite database at `db_path`, creating its
+// tables if needed. Replays are read by up to `jobs` threads while a single
+// connection writes them in large transactions. The raw duel messages are
+// only stored if `with_messages` is set. Returns false if the database could
+// not be written or any replay failed to load, the rest are still stored. If
+// the database fails, the export stops and only whole transactions are kept.
+auto export_sqlite(std::string_view exe, std::string_view db_path,
+                   std::vector<std::string_view> const& replays, unsigned jobs,
+                   bool with_messages) noexcept -> bool;
+
+#endif // ERP_EXPORT_SQLITE_HPP
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "extract_yrp.hpp"
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "framing.hpp"
+#include "parallel.hpp"
+#include "recompress.hpp"
+#include "replay_file.hpp"
+
+namespace
+{
+
+auto extract_yrp(std::string_view exe, std::string_view fn,
+                 std::string const& out_path, bool decompress) noexcept -> bool
+{
+	auto [success, header, buffer, file_size] = load_replay(exe, fn);
+	if(!success)
+		return false; // NOTE: Error printed by `load_replay`.
+	auto* ptr_to_msgs = buffer.data();
+	auto const* const sentry = ptr_to_msgs + buffer.size();
+	if(!skip_duelists(header.base.flags, ptr_to_msgs, sentry) ||
+	   !read_duel_flags(header.base.flags, ptr_to_msgs, sentry))
+	{
+		std::cerr << exe << ": Replay is truncated.\n";
+		return false;
+	}
+	auto const orm = find_old_replay_mode(
+		exe, ptr_to_msgs, buffer.size() - (ptr_to_msgs - buffer.data()));
+	if(!orm.success)
+		return false; // NOTE: Error printed by `find_old_replay_mode`.
+	if(orm.old_replay_mode_buffer == nullptr)
+	{
+		std::cerr << exe << ": Replay doesn't have OLD_REPLAY_MODE.\n";
+		return false;
+	}
+	auto const* const data = orm.old_replay_mode_buffer;
+	auto const size = orm.old_replay_mode_size;
+	if(!decompress)
+	{
+		// NOTE: Written as stored, only its header is checked.
+		if(size < sizeof(ExtendedReplayHeader))
+		{
+			std::cerr << exe << ": Yrp buffer too small.\n";
+			return false;
+		}
+		if(!read_header(exe, data, REPLAY_YRP1).success)
+			return false; // NOTE: Error printed by `read_header`.
+		return write_file(exe, out_path, {data, data + size});
+	}
+	auto yrp = load_old_replay(exe, orm.old_replay_mode_buffer, size);
+	if(!yrp.success)
+		return false; // NOTE: Error printed by `load_old_replay`.
+	if((yrp.header.base.flags & REPLAY_COMPRESSED) == 0U)
+		return write_file(exe, out_path, {data, data + size});
+	yrp.header.base.flags &= ~REPLAY_COMPRESSED;
+	yrp.header.base.size = static_cast<uint32_t>(yrp.size);
+	return write_file(exe, out_path,
+	                  serialize_replay(yrp.header, yrp.decompressed));
+}
+
+} // namespace
+
+auto extract_yrps(std::string_view exe, std::string_view out_dir,
+                  std::vector<std::string_view> const& replays, unsigned jobs,
+                  bool decompress) noexcept -> bool
+{
+	bool all_success = true;
+	parallel_ordered(
+		replays.size(), jobs,
+		[&](size_t i) -> bool
+		{
+			auto const fn = replays[i];
+			auto const prefixed_exe = std::string{exe} + ": " + std::string{fn};
+			auto const out_path =
+				std::filesystem::path{out_dir} /
+				std::filesystem::path{fn}.stem().concat(".yrp");
+			return extract_yrp(prefixed_exe, fn, out_path.string(), decompress);
+		},
+		[&](size_t /*i*/, bool success)
+		{ all_success = all_success && success; });
+	return all_success;
+}
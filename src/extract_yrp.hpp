@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_EXTRACT_YRP_HPP
+#define ERP_EXTRACT_YRP_HPP
+#include <string_view>
+#include <vector>
+
+// Writes the yrp embedded in each replay to `out_dir`/<REPLAY name>.yrp,
+// either as stored or with its contents decompressed if `decompress` is set.
+// Messages are only framed, not encoded. Up to `jobs` replays are extracted
+// in parallel. Returns false if any replay failed.
+auto extract_yrps(std::string_view exe, std::string_view out_dir,
+                  std::vector<std::string_view> const& replays, unsigned jobs,
+                  bool decompress) noexcept -> bool;
+
+#endif // ERP_EXTRACT_YRP_HPP
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "framing.hpp"
+
+#include <cstring> // std::memcpy
+#include <iostream>
+
+auto next_message(std::string_view exe, uint8_t const*& buffer,
+                  uint8_t const* sentry, MessageFrame& msg) noexcept -> bool
+{
+	// NOTE: Each message is laid out as its type, then its size and then
+	// its contents.
+	if(static_cast<size_t>(sentry - buffer) <
+	   sizeof(uint8_t) + sizeof(uint32_t))
+	{
+		std::cerr << exe << ": Unexpectedly short size for next message.\n";
+		return false;
+	}
+	std::memcpy(&msg.type, buffer, sizeof(msg.type));
+	std::memcpy(&msg.size, buffer + sizeof(msg.type), sizeof(msg.size));
+	buffer += sizeof(msg.type) + sizeof(msg.size);
+	if(static_cast<size_t>(sentry - buffer) < msg.size)
+	{
+		std::cerr << exe << ": Read length for message is mismatched.\n";
+		return false;
+	}
+	msg.data = buffer;
+	buffer += msg.size;
+	return true;
+}
+
+auto find_old_replay_mode(std::string_view exe, uint8_t* buffer,
+                          size_t size) noexcept -> FindOldReplayModeResult
+{
+	uint8_t const* ptr = buffer;
+	uint8_t const* const sentry = buffer + size;
+	MessageFrame msg{};
+	while(sentry != ptr)
+	{
+		if(!next_message(exe, ptr, sentry, msg))
+			return {false, {}, {}};
+		if(msg.type == 231U) // NOLINT: OLD_REPLAY_FORMAT
+			return {true, buffer + (msg.data - buffer), msg.size};
+	}
+	return {true, nullptr, 0U};
+}
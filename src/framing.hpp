@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_FRAMING_HPP
+#define ERP_FRAMING_HPP
+#include <cstdint>
+#include <string_view>
+
+// Whether a core message asks a duelist for a response, in which case it
+// consumes the next response stored in the replay.
+constexpr auto is_prompt(uint8_t msg_type) noexcept -> bool
+{
+	switch(msg_type)
+	{
+	case 10U:  // MSG_SELECT_BATTLECMD
+	case 11U:  // MSG_SELECT_IDLECMD
+	case 12U:  // MSG_SELECT_EFFECTYN
+	case 13U:  // MSG_SELECT_YESNO
+	case 14U:  // MSG_SELECT_OPTION
+	case 15U:  // MSG_SELECT_CARD
+	case 16U:  // MSG_SELECT_CHAIN
+	case 18U:  // MSG_SELECT_PLACE
+	case 19U:  // MSG_SELECT_POSITION
+	case 20U:  // MSG_SELECT_TRIBUTE
+	case 21U:  // MSG_SORT_CHAIN
+	case 22U:  // MSG_SELECT_COUNTER
+	case 23U:  // MSG_SELECT_SUM
+	case 24U:  // MSG_SELECT_DISFIELD
+	case 25U:  // MSG_SORT_CARD
+	case 26U:  // MSG_SELECT_UNSELECT_CARD
+	case 132U: // MSG_ROCK_PAPER_SCISSORS
+	case 140U: // MSG_ANNOUNCE_RACE
+	case 141U: // MSG_ANNOUNCE_ATTRIB
+	case 142U: // MSG_ANNOUNCE_CARD
+	case 143U: // MSG_ANNOUNCE_NUMBER
+		return true;
+	default:
+		return false;
+	}
+}
+
+struct MessageFrame
+{
+	uint8_t type;
+	uint32_t size;
+	uint8_t const* data; // Contents of the message, without type and size.
+};
+
+// Splits the message at `buffer` off and advances past it. Returns false,
+// printing why, if the bytes left before `sentry` cannot hold it.
+auto next_message(std::string_view exe, uint8_t const*& buffer,
+                  uint8_t const* sentry, MessageFrame& msg) noexcept -> bool;
+
+struct FindOldReplayModeResult
+{
+	bool success;
+	uint8_t* old_replay_mode_buffer;
+	size_t old_replay_mode_size;
+};
+
+// Finds the OLD_REPLAY_MODE block by walking the size prefix of each message,
+// without encoding any of them. Unlike `analyze`, the buffer is not modified.
+auto find_old_replay_mode(std::string_view exe, uint8_t* buffer,
+                          size_t size) noexcept -> FindOldReplayModeResult;
+
+#endif // ERP_FRAMING_HPP
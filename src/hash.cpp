@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "hash.hpp"
+
+#include <cstring> // std::memcpy
+
+auto content_hash(std::string_view data) noexcept -> uint64_t
+{
+	uint64_t h = 0x9E3779B97F4A7C15U ^ data.size();
+	size_t i = 0U;
+	for(; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t))
+	{
+		uint64_t w{};
+		std::memcpy(&w, data.data() + i, sizeof(w));
+		h = mix64(h ^ w) + (h << 7U);
+	}
+	uint64_t tail{};
+	std::memcpy(&tail, data.data() + i, data.size() - i);
+	return mix64(h ^ tail);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_HASH_HPP
+#define ERP_HASH_HPP
+#include <cstdint>
+#include <string_view>
+
+// Non-cryptographic hashing for tables and fingerprints. Each of these can be
+// inverted, so they must not be used where an adversary picks the input and
+// gains from a collision.
+
+// murmur3's 32-bit finalizer.
+constexpr auto mix32(uint32_t h) noexcept -> uint32_t
+{
+	h ^= h >> 16U;
+	h *= 0x85EBCA6BU;
+	h ^= h >> 13U;
+	h *= 0xC2B2AE35U;
+	h ^= h >> 16U;
+	return h;
+}
+
+// murmur3's 64-bit finalizer.
+constexpr auto mix64(uint64_t h) noexcept -> uint64_t
+{
+	h ^= h >> 33U;
+	h *= 0xFF51AFD7ED558CCDU;
+	h ^= h >> 33U;
+	h *= 0xC4CEB9FE1A85EC53U;
+	h ^= h >> 33U;
+	return h;
+}
+
+// 8 bytes at a time with `mix64`, fast enough for whole replays.
+auto content_hash(std::string_view data) noexcept -> uint64_t;
+
+#endif // ERP_HASH_HPP
@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "ingest_ring.hpp"
+
+#include <array>
+#include <chrono>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring> // std::memcpy, std::memset, std::strerror
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <linux/futex.h>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "metrics.hpp"
+
+// Ring file layout:
+//   Header
+//   uint8_t data[capacity]
+// Records in `data` are 8-byte aligned and never wrap around, a producer
+// that doesn't fit before the end pads up to it first:
+//   uint32_t state   EMPTY, RESERVED, REPLAY or PADDING.
+//   uint32_t size    Bytes that follow, not counting alignment.
+// A producer sets the size and RESERVED right after its CAS, then copies the
+// replay and sets REPLAY, so the consumer can step over the record of a
+// producer that died while copying.
+struct IngestRing::Header
+{
+	std::array<char, 8U> magic;
+	uint64_t capacity;
+	alignas(64) std::atomic<uint64_t> reserve; // End of what was reserved.
+	alignas(64) std::atomic<uint64_t> tail;    // End of what was taken.
+	alignas(64) std::atomic<uint32_t> doorbell; // Futex, bumped on publish.
+	std::atomic<uint32_t> waiting;              // Consumer is asleep.
+	std::atomic<uint32_t> closed;
+};
+
+namespace
+{
+
+constexpr std::array<char, 8U> MAGIC{'E', 'R', 'P', 'R', 'I', 'N', 'G', '1'};
+constexpr size_t MIN_CAPACITY = 64U * 1024U;
+constexpr uint64_t RECORD_HEADER = 8U;
+// How long the consumer waits on a reserved record before giving up on its
+// producer. Copying a replay takes far less, so only a dead (or stopped)
+// producer gets here.
+constexpr auto STALL_TIMEOUT = std::chrono::seconds(10);
+
+enum : uint32_t
+{
+	EMPTY = 0U,
+	REPLAY,
+	PADDING,
+	RESERVED,
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "Ring atomics must work across processes");
+
+constexpr auto align8(uint64_t n) noexcept -> uint64_t
+{
+	return (n + 7U) & ~uint64_t{7U};
+}
+
+auto state_of(uint8_t* rec) noexcept -> std::atomic<uint32_t>&
+{
+	return *reinterpret_cast<std::atomic<uint32_t>*>(rec);
+}
+
+auto futex(std::atomic<uint32_t>& word, int op, uint32_t val,
+           timespec const* timeout) noexcept -> void
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, val, timeout,
+	        nullptr, 0);
+}
+
+} // namespace
+
+IngestRing::~IngestRing() noexcept
+{
+	if(header_ != nullptr)
+		munmap(header_, map_size_);
+}
+
+auto IngestRing::create(std::string_view exe, std::string_view path,
+                        size_t capacity) noexcept -> bool
+{
+	uint64_t cap = MIN_CAPACITY;
+	while(cap < capacity)
+		cap <<= 1U;
+	std::string const fn{path};
+	int const fd = ::open(fn.data(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+	                      0600);
+	map_size_ = sizeof(Header) + cap;
+	void* map = MAP_FAILED;
+	if(fd != -1 && ftruncate(fd, static_cast<off_t>(map_size_)) == 0)
+		map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		           0);
+	if(map == MAP_FAILED)
+	{
+		std::cerr << exe << ": Could not create ring '" << path
+				  << "': " << std::strerror(errno) << ".\n";
+		if(fd != -1)
+			::close(fd);
+		return false;
+	}
+	::close(fd);
+	// NOTE: The file was just truncated, so everything starts zeroed.
+	header_ = new(map) Header{MAGIC, cap, {}, {}, {}, {}, {}};
+	data_ = static_cast<uint8_t*>(map) + sizeof(Header);
+	tail_ = 0U;
+	exe_ = exe;
+	return true;
+}
+
+auto IngestRing::open(std::string_view exe,
+                      std::string_view path) noexcept -> bool
+{
+	std::string const fn{path};
+	int const fd = ::open(fn.data(), O_RDWR | O_CLOEXEC);
+	struct stat st{};
+	if(fd == -1 || fstat(fd, &st) != 0)
+	{
+		std::cerr << exe << ": Could not open ring '" << path << "'.\n";
+		if(fd != -1)
+			::close(fd);
+		return false;
+	}
+	map_size_ = static_cast<size_t>(st.st_size);
+	void* map = MAP_FAILED;
+	if(map_size_ > sizeof(Header))
+		map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		           0);
+	::close(fd);
+	if(map == MAP_FAILED)
+	{
+		std::cerr << exe << ": Could not map ring '" << path << "'.\n";
+		return false;
+	}
+	header_ = static_cast<Header*>(map);
+	data_ = static_cast<uint8_t*>(map) + sizeof(Header);
+	if(header_->magic != MAGIC ||
+	   sizeof(Header) + header_->capacity != map_size_)
+	{
+		std::cerr << exe << ": '" << path << "' is not a ring.\n";
+		munmap(map, map_size_);
+		header_ = nullptr;
+		return false;
+	}
+	return true;
+}
+
+auto IngestRing::push(std::string_view replay) noexcept -> PushResult
+{
+	auto const cap = header_->capacity;
+	uint64_t const need = RECORD_HEADER + align8(replay.size());
+	if(replay.size() > UINT32_MAX || need > cap / 2U)
+		return PushResult::TOO_BIG;
+	if(header_->closed.load(std::memory_order_acquire) != 0U)
+		return PushResult::CLOSED;
+	uint64_t pos = header_->reserve.load(std::memory_order_relaxed);
+	uint64_t pad{};
+	do
+	{
+		auto const contiguous = cap - (pos & (cap - 1U));
+		pad = need <= contiguous ? 0U : contiguous;
+		if(pos + pad + need - header_->tail.load(std::memory_order_acquire) >
+		   cap)
+			return PushResult::FULL;
+	} while(!header_->reserve.compare_exchange_weak(pos, pos + pad + need,
+	                                                std::memory_order_acq_rel,
+	                                                std::memory_order_relaxed));
+	auto publish = [](uint8_t* rec, uint32_t state, uint64_t size)
+	{
+		auto const size32 = static_cast<uint32_t>(size);
+		std::memcpy(rec + 4U, &size32, sizeof(size32));
+		state_of(rec).store(state, std::memory_order_release);
+	};
+	if(pad != 0U)
+		publish(record(pos), PADDING, pad - RECORD_HEADER);
+	auto* rec = record(pos + pad);
+	publish(rec, RESERVED, replay.size());
+	std::memcpy(rec + RECORD_HEADER, replay.data(), replay.size());
+	// NOTE: Fails if the consumer already gave up on this record.
+	auto expected = uint32_t{RESERVED};
+	if(!state_of(rec).compare_exchange_strong(expected, REPLAY,
+	                                          std::memory_order_release,
+	                                          std::memory_order_relaxed))
+		return PushResult::CLOSED;
+	// NOTE: Pairs with the consumer setting `waiting` before sleeping on
+	// `doorbell`, either it sees the new value or we see it waiting.
+	header_->doorbell.fetch_add(1U);
+	if(header_->waiting.load() != 0U)
+		futex(header_->doorbell, FUTEX_WAKE, 1U, nullptr);
+	return PushResult::PUSHED;
+}
+
+auto IngestRing::pop() noexcept -> std::optional<std::string>
+{
+	constexpr timespec TIMEOUT{0, 100'000'000};
+	using Clock = std::chrono::steady_clock;
+	// NOTE: Since when the record at `tail_` has been reserved but not
+	// published.
+	std::optional<Clock::time_point> stalled_since;
+	bool reported = false;
+	for(unsigned spins = 0U;;)
+	{
+		auto* rec = record(tail_);
+		auto const seen = header_->doorbell.load();
+		auto state = state_of(rec).load(std::memory_order_acquire);
+		bool const closed =
+			header_->closed.load(std::memory_order_acquire) != 0U;
+		bool const reserved =
+			header_->reserve.load(std::memory_order_acquire) != tail_;
+		if(state == EMPTY || state == RESERVED)
+		{
+			// NOTE: A push that raced `close` may be left behind.
+			if(closed && !reserved)
+				return std::nullopt;
+			if(!reserved)
+				stalled_since.reset();
+			else if(!stalled_since.has_value())
+				stalled_since = Clock::now();
+			else if(Clock::now() - *stalled_since > STALL_TIMEOUT)
+			{
+				// NOTE: The producer died, or was stopped, before publishing.
+				// Its record can only be stepped over if it got as far as
+				// setting the size.
+				if(state == RESERVED &&
+				   state_of(rec).compare_exchange_strong(
+					   state, PADDING, std::memory_order_acquire))
+				{
+					std::cerr << exe_ << ": Skipped a replay its producer "
+					          << "never finished writing.\n";
+					lost_++;
+					stalled_since.reset();
+					reported = false;
+					continue;
+				}
+				if(state == EMPTY && closed)
+				{
+					std::cerr << exe_ << ": A producer reserved room in the "
+					          << "ring but never wrote to it, giving up.\n";
+					lost_++;
+					return std::nullopt;
+				}
+				if(state == EMPTY && !reported)
+				{
+					std::cerr << exe_ << ": Waiting on a producer that "
+					          << "reserved room in the ring but never wrote "
+					          << "to it.\n";
+					reported = true;
+				}
+			}
+			if(state == EMPTY || state == RESERVED)
+			{
+				if(++spins < 64U)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				header_->waiting.store(1U);
+				futex(header_->doorbell, FUTEX_WAIT, seen, &TIMEOUT);
+				header_->waiting.store(0U);
+				continue;
+			}
+		}
+		uint32_t size{};
+		std::memcpy(&size, rec + 4U, sizeof(size));
+		std::optional<std::string> replay;
+		if(state == REPLAY)
+			replay.emplace(reinterpret_cast<char const*>(rec + RECORD_HEADER),
+			               size);
+		auto const len = RECORD_HEADER + align8(size);
+		std::memset(rec, 0, len);
+		tail_ += len;
+		header_->tail.store(tail_, std::memory_order_release);
+		if(replay.has_value())
+			return replay;
+		spins = 0U;
+		stalled_since.reset();
+		reported = false;
+	}
+}
+
+auto IngestRing::close() noexcept -> void
+{
+	header_->closed.store(1U, std::memory_order_release);
+	header_->doorbell.fetch_add(1U);
+	futex(header_->doorbell, FUTEX_WAKE, 1U, nullptr);
+}
+
+auto IngestRing::record(uint64_t pos) const noexcept -> uint8_t*
+{
+	return data_ + (pos & (header_->capacity - 1U));
+}
+
+auto consume_ring(std::string_view exe, IngestRing& ring, unsigned jobs,
+                  IngestHandler const& handler, std::ostream& out) noexcept
+	-> bool
+{
+	size_t const window = size_t{jobs} * 2U;
+	std::mutex mtx;
+	std::condition_variable produced;
+	std::condition_variable consumed;
+	std::deque<std::pair<uint64_t, std::string>> queue;
+	bool done = false;
+	std::mutex out_mtx;
+	std::atomic<bool> all_success{true};
+	auto worker = [&]()
+	{
+		for(;;)
+		{
+			std::pair<uint64_t, std::string> item;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				produced.wait(lock, [&]() { return done || !queue.empty(); });
+				if(queue.empty())
+					return;
+				item = std::move(queue.front());
+				queue.pop_front();
+			}
+			consumed.notify_one();
+			auto const& [seq, content] = item;
+			std::ostringstream buffer;
+			buffer << "==> #" << seq << " <==\n";
+			auto const prefixed_exe =
+				std::string{exe} + ": #" + std::to_string(seq);
+			if(!handler(prefixed_exe, seq, content, buffer))
+				all_success = false;
+			metrics_bytes_out(static_cast<uint64_t>(buffer.tellp()));
+			std::lock_guard<std::mutex> lock(out_mtx);
+			out << buffer.str() << std::flush;
+		}
+	};
+	metrics_add_value("erp_ingest_queue_depth",
+	                  "Replays taken from the ring, waiting for a worker.",
+	                  "gauge",
+	                  [&]() -> double
+	                  {
+						  std::lock_guard<std::mutex> lock(mtx);
+						  return static_cast<double>(queue.size());
+					  });
+	std::vector<std::thread> threads;
+	threads.reserve(jobs);
+	for(unsigned j = 0U; j < jobs; j++)
+		threads.emplace_back(worker);
+	for(uint64_t seq = 0U;; seq++)
+	{
+		auto replay = ring.pop();
+		if(!replay.has_value())
+			break;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			consumed.wait(lock, [&]() { return queue.size() < window; });
+			queue.emplace_back(seq, std::move(*replay));
+		}
+		produced.notify_one();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		done = true;
+	}
+	produced.notify_all();
+	for(auto& t : threads)
+		t.join();
+	metrics_remove_values("erp_ingest_");
+	return all_success && ring.lost() == 0U;
+}
+
+auto push_replay_files(std::string_view exe, std::string_view path,
+                       std::vector<std::string_view> const& replays,
+                       bool close) noexcept -> bool
+{
+	IngestRing ring;
+	if(!ring.open(exe, path))
+		return false; // NOTE: Error printed by `IngestRing::open`.
+	for(auto const fn : replays)
+	{
+		std::ifstream f(std::string{fn}, std::ios_base::binary | std::ios_base::in);
+		if(!f.is_open())
+		{
+			std::cerr << exe << ": Could not open file '" << fn << "'.\n";
+			return false;
+		}
+		std::string const content(std::istreambuf_iterator<char>(f),
+		                          std::istreambuf_iterator<char>{});
+		auto r = IngestRing::PushResult::FULL;
+		while((r = ring.push(content)) == IngestRing::PushResult::FULL)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		if(r != IngestRing::PushResult::PUSHED)
+		{
+			std::cerr << exe << ": Could not push '" << fn << "': "
+					  << (r == IngestRing::PushResult::CLOSED
+			                  ? "ring is closed"
+			                  : "too big for the ring")
+					  << ".\n";
+			return false;
+		}
+	}
+	if(close)
+		ring.close();
+	return true;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_INGEST_RING_HPP
+#define ERP_INGEST_RING_HPP
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Multi-producer, single-consumer ring of replays in a shared memory file
+// (e.g. under /dev/shm), so processes on the same host can hand replays over
+// without going through the disk. Producers reserve space with a CAS, copy
+// the replay in and then publish it; the consumer takes them in reservation
+// order and zeroes what it read so the next reservation starts clean.
+// A futex on the ring lets the consumer sleep while it's empty. If a producer
+// dies before publishing, the consumer skips its record after a timeout, or
+// stops once the ring is closed if it can't tell how big the record was.
+class IngestRing final
+{
+public:
+	IngestRing() noexcept = default;
+	IngestRing(IngestRing const&) = delete;
+	IngestRing& operator=(IngestRing const&) = delete;
+	~IngestRing() noexcept;
+
+	// Creates (or recreates) the ring at `path` with room for `capacity`
+	// bytes, rounded up to a power of two. Done by the consumer.
+	auto create(std::string_view exe, std::string_view path,
+	            size_t capacity) noexcept -> bool;
+
+	// Attaches to the ring at `path`. Done by producers.
+	auto open(std::string_view exe, std::string_view path) noexcept -> bool;
+
+	enum class PushResult
+	{
+		PUSHED,
+		FULL,
+		TOO_BIG, // Bigger than half the ring, it would never fit.
+		CLOSED,
+	};
+
+	// Never blocks, producers decide whether to retry when FULL. Also
+	// CLOSED if the consumer gave up on the replay while it was copied.
+	auto push(std::string_view replay) noexcept -> PushResult;
+
+	// Waits for the next replay. Returns nothing once the ring was closed
+	// and everything in it was taken, or a dead producer left a record that
+	// can't be skipped.
+	auto pop() noexcept -> std::optional<std::string>;
+
+	// Replays `pop` gave up on because their producer never published them.
+	auto lost() const noexcept -> uint64_t
+	{
+		return lost_;
+	}
+
+	// Tells the consumer no more replays will come.
+	auto close() noexcept -> void;
+
+private:
+	struct Header;
+
+	auto record(uint64_t pos) const noexcept -> uint8_t*;
+
+	Header* header_{};
+	uint8_t* data_{};
+	size_t map_size_{};
+	uint64_t tail_{}; // Consumer's own copy of the tail.
+	uint64_t lost_{};
+	std::string exe_; // For the consumer to report stalls.
+};
+
+// Writes what the consumer was asked for about replay `content`, the
+// `seq`-th taken from the ring, to `out`. Returns false on error.
+using IngestHandler = std::function<bool(
+	std::string_view exe, uint64_t seq, std::string const& content,
+	std::ostream& out)>;
+
+// Takes replays from `ring` until it's closed, parsing them with `jobs`
+// threads. The output of each is preceded by "==> #<seq> <==" and written
+// to `out` as soon as it's ready, so not necessarily in order. Returns
+// whether all replays were processed successfully.
+auto consume_ring(std::string_view exe, IngestRing& ring, unsigned jobs,
+                  IngestHandler const& handler, std::ostream& out) noexcept
+	-> bool;
+
+// Test producer: pushes the contents of each file in `replays` to the ring
+// at `path`, waiting while it's full, then closes it if `close` is set.
+auto push_replay_files(std::string_view exe, std::string_view path,
+                       std::vector<std::string_view> const& replays,
+                       bool close) noexcept -> bool;
+
+#endif // ERP_INGEST_RING_HPP
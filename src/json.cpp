@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "json.hpp"
+
+#include <iomanip>
+#include <ostream>
+
+auto print_json_string(std::ostream& out, std::string_view str) noexcept
+	-> void
+{
+	out << '"';
+	for(auto const c : str)
+	{
+		if(c == '"' || c == '\\')
+			out << '\\' << c;
+		else if(static_cast<unsigned char>(c) < 0x20U)
+			out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+				<< static_cast<unsigned>(c) << std::dec;
+		else
+			out << c;
+	}
+	out << '"';
+}
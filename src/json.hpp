@@ -0,0 +1,15 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_JSON_HPP
+#define ERP_JSON_HPP
+#include <iosfwd>
+#include <string_view>
+
+// Prints `str` quoted, escaping what JSON requires.
+auto print_json_string(std::ostream& out, std::string_view str) noexcept
+	-> void;
+
+#endif // ERP_JSON_HPP
@@ -3,30 +3,76 @@
  *
  * SPDX-License-Identifier: AGPL-3.0-or-later
  */
-#include <array>
+#include <algorithm> // std::sort, std::unique
+#include <cassert>
+#include <charconv> // std::from_chars
+#include <cstdlib>
 #include <cstring> // std::memcpy
+#include <filesystem>
 #include <fstream>
-#include <google/protobuf/stubs/common.h>
+#include <functional>
 #include <iomanip>
 #include <iostream>
-#include <limits> // std::numeric_limits
 #include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
-#include "decompress.hpp"
+#include "anonymize.hpp"
+#include "banlist.hpp"
+#include "card_db.hpp"
+#include "compact.hpp"
+#include "compress.hpp"
+#include "diff.hpp"
+#include "export_sqlite.hpp"
+#include "extract_yrp.hpp"
+#include "framing.hpp"
+#include "ingest_ring.hpp"
+#include "json.hpp"
+#include "message_columns.hpp"
+#include "metrics.hpp"
+#include "parallel.hpp"
 #include "parser.hpp"
 #include "print_date.hpp"
 #include "print_names.hpp"
+#include "probes.hpp"
 #include "replay_data.hpp"
+#include "replay_file.hpp"
+#include "replay_store.hpp"
+#include "server.hpp"
+#include "tensors.hpp"
+#include "viewer_bundle.hpp"
 
 namespace
 {
 
 #include "read.inl"
 
-constexpr auto IOS_IN = std::ios_base::binary | std::ios_base::in;
 constexpr auto IOS_OUT = std::ios_base::binary | std::ios_base::out;
 
+// Writes `s` as C escapes would, so it can't break a line based format.
+auto print_escaped_line(std::ostream& out, std::string_view s) noexcept -> void
+{
+	constexpr std::string_view HEX = "0123456789abcdef";
+	for(auto const c : s)
+	{
+		auto const u = static_cast<unsigned char>(c);
+		if(c == '\\')
+			out << "\\\\";
+		else if(c == '\n')
+			out << "\\n";
+		else if(c == '\r')
+			out << "\\r";
+		else if(c == '\t')
+			out << "\\t";
+		else if(u < 0x20U || u == 0x7FU)
+			out << "\\x" << HEX[u >> 4U] << HEX[u & 0xFU];
+		else
+			out << c;
+	}
+}
+
 auto print_usage(std::string_view exe) noexcept -> void
 {
 	std::cerr << "\nUsage: " << exe << " [--names]"
@@ -37,7 +83,46 @@ auto print_usage(std::string_view exe) noexcept -> void
 			  << "\n       " << std::string(exe.length(), ' ')
 			  << " [--duel-msgs]"
 			  << " [--duel-responses]"
-			  << " REPLAY\n\n";
+			  << " [--duel-prompts]"
+			  << " [--timeline]"
+			  << "\n       " << std::string(exe.length(), ' ')
+			  << " [--trajectories]"
+			  << "\n       " << std::string(exe.length(), ' ')
+			  << " [--card-db FILE]"
+			  << " [--check-banlist FILE]"
+			  << " [--export-tensors DIR]"
+			  << "\n       " << std::string(exe.length(), ' ')
+			  << " [--export-timeline DIR]"
+			  << " [--export-columns DIR]"
+			  << "\n       " << std::string(exe.length(), ' ')
+			  << " [--export-store DIR]"
+			  << " [--viewer-bundle DIR]"
+			  << "\n       " << std::string(exe.length(), ' ')
+			  << " [--compress CODEC[:LEVEL]]"
+			  << " [--compress-dict FILE]"
+			  << "\n       " << std::string(exe.length(), ' ')
+			  << " [--metrics FILE]"
+			  << " [--metrics-port PORT]"
+			  << " [-j N]"
+			  << " REPLAY...\n"
+			  << "       " << exe << " compile-card-db CDB OUT\n"
+			  << "       " << exe << " diff A B\n"
+			  << "       " << exe
+			  << " export-sqlite [--messages] [-j N] OUT REPLAY...\n"
+			  << "       " << exe
+			  << " anonymize (--salt SALT | --key-file FILE) [-j N]"
+			  << " OUT_DIR REPLAY...\n"
+			  << "       " << exe << " compact [-j N] OUT_DIR REPLAY...\n"
+			  << "       " << exe
+			  << " extract-yrp [--decompress] [-j N] OUT_DIR REPLAY...\n"
+			  << "       " << exe << " read-store STORE [FIRST [COUNT]]\n"
+			  << "       " << exe
+			  << " serve [--card-db FILE] [--cache-size MIB] [-j N]"
+			  << " [--client-jobs N] [METRICS...] SOCKET\n"
+			  << "       " << exe
+			  << " ingest [FLAGS...] [--card-db FILE] [--ring-size MIB] [-j N]"
+			  << " [METRICS...] RING\n"
+			  << "       " << exe << " ring-push [--close] RING REPLAY...\n\n";
 	std::cerr << "  --names\t\tPrint names of all the duelists.\n";
 	std::cerr << "  --date\t\tPrint date of the replay (when the "
 				 "duel started).\n";
@@ -49,388 +134,1159 @@ auto print_usage(std::string_view exe) noexcept -> void
 				 "(in hexadecimal).\n";
 	std::cerr << "  --duel-msgs\t\tPrint all the parsed messages.\n";
 	std::cerr << "  --duel-resps\t\tPrint all responses.\n";
-	std::cerr << "  REPLAY\t\tReplay file to parse (required).\n";
+	std::cerr << "  --duel-prompts\tPrint each message that asks for a "
+				 "response along with\n\t\t\tthe response given to it.\n";
+	std::cerr << "  --timeline\t\tPrint board stats sampled at each turn and "
+				 "phase\n\t\t\tboundary, one array per stat.\n";
+	std::cerr << "  --trajectories\tPrint every place each card has been "
+				 "at, with the\n\t\t\tmessage index and turn of each "
+				 "move.\n";
+	std::cerr << "  --card-db FILE\tAnnotate decks and messages with card "
+				 "names and types\n\t\t\tfrom a card database or a "
+				 "compiled card table.\n";
+	std::cerr << "  --check-banlist FILE\tPrint the cards of each deck that go "
+				 "over the limits\n\t\t\tof the first list in FILE "
+				 "(lflist.conf format).\n";
+	std::cerr << "  --export-tensors DIR\tWrite the board at each decision "
+				 "with the response\n\t\t\ttaken to DIR/<REPLAY name>.npy.\n";
+	std::cerr << "  --export-timeline DIR\tWrite the timeline in binary "
+				 "columnar format to\n\t\t\tDIR/<REPLAY name>.erptl.\n";
+	std::cerr << "  --export-columns DIR\tWrite the type, turn and card of "
+				 "every message in\n\t\t\tcompressed columnar format to "
+				 "DIR/<REPLAY name>.erpmc.\n";
+	std::cerr << "  --export-store DIR\tWrite the parsed messages to "
+				 "DIR/<REPLAY name>.erpps, to\n\t\t\tbe read back with "
+				 "read-store.\n";
+	std::cerr << "  --viewer-bundle DIR\tWrite a manifest and the parsed "
+				 "messages of each turn\n\t\t\tto DIR/<REPLAY name>/, for "
+				 "viewers to fetch lazily.\n";
+	std::cerr << "  --compress CODEC[:LEVEL]\n\t\t\tCompress the output of "
+				 "each replay with gzip or zstd,\n\t\t\tin the thread "
+				 "that parsed it.\n";
+	std::cerr << "  --compress-dict FILE\tUse the zstd dictionary FILE "
+				 "for --compress.\n";
+	std::cerr << "  --metrics FILE\tWrite Prometheus metrics to FILE every "
+				 "10 seconds and\n\t\t\tat exit. Also taken by serve and "
+				 "ingest, as\n\t\t\tMETRICS.\n";
+	std::cerr << "  --metrics-port PORT\tServe Prometheus metrics over HTTP "
+				 "on\n\t\t\t127.0.0.1:PORT. Also taken by serve and "
+				 "ingest.\n";
+	std::cerr << "  -j, --jobs N\t\tParse up to N replays in parallel "
+				 "(0 for one per core).\n";
+	std::cerr << "  REPLAY\t\tReplay file to parse (required). When "
+				 "given more than one,\n\t\t\tthe output of each is "
+				 "preceded by \"==> REPLAY <==\".\n";
+	std::cerr << "\n  compile-card-db\tCompile the card database CDB into "
+				 "a card table at OUT.\n";
+	std::cerr << "  diff\t\t\tPrint the first message where replays A and "
+				 "B diverge,\n\t\t\twith the board before it.\n";
+	std::cerr << "  export-sqlite		Store names, decks, options and outcome "
+				 "of each REPLAY\n\t\t\tin the SQLite database OUT, plus "
+				 "the raw messages\n\t\t\twith --messages.\n";
+	std::cerr << "  anonymize		Write each REPLAY to OUT_DIR with the names "
+				 "of the\n\t\t\tduelists replaced by pseudonyms keyed "
+				 "by SALT, or\n\t\t\tthe contents of FILE, which must be "
+				 "kept secret.\n";
+	std::cerr << "  compact		Write each REPLAY to OUT_DIR without redundant "
+				 "queries\n\t\t\tand with stronger compression, checked "
+				 "by parsing\n\t\t\tit again.\n";
+	std::cerr << "  extract-yrp		Write the yrp embedded in each REPLAY to "
+				 "OUT_DIR/<REPLAY\n\t\t\tname>.yrp, with its contents "
+				 "decompressed if\n\t\t\t--decompress is given.\n";
+	std::cerr << "  read-store		Print messages [FIRST, FIRST + COUNT) of "
+				 "STORE like\n\t\t\t--duel-msgs does, all of them by "
+				 "default.\n";
+	std::cerr << "  serve\t\t\tAnswer requests made of print flags and a "
+				 "replay path\n\t\t\ton the Unix socket SOCKET, caching "
+				 "up to MIB\n\t\t\t(default 256) of results by replay "
+				 "contents.\n\t\t\tThe request STATS prints cache "
+				 "counters. With --memfd\n\t\t\tthe result is passed "
+				 "as a sealed memfd. Requests\n\t\t\twith --bulk give "
+				 "way to the others, and each\n\t\t\tclient process "
+				 "runs at most --client-jobs N at\n\t\t\tonce (default "
+				 "-j).\n";
+	std::cerr << "  ingest\t\tCreate the shared memory ring RING (e.g. in "
+				 "/dev/shm),\n\t\t\tof MIB (default 64), and print what "
+				 "the print\n\t\t\tFLAGS ask for about each replay "
+				 "pushed to it\n\t\t\tuntil it's closed.\n";
+	std::cerr << "  ring-push\t\tPush each REPLAY to RING, closing it "
+				 "afterwards with\n\t\t\t--close. Meant for testing "
+				 "ingest.\n";
 }
 
-struct ReadHeaderResult
+// DIR/<stem of REPLAY><ext>
+auto output_path(std::string_view dir, std::string_view fn,
+                 std::string_view ext) noexcept -> std::string
 {
-	bool success{};
-	ExtendedReplayHeader header{};
-};
+	return (std::filesystem::path{dir} /
+	        std::filesystem::path{fn}.stem().concat(ext))
+		.string();
+}
 
-auto read_header(std::string_view exe, uint8_t const* buffer_data,
-                 ReplayTypes magic) noexcept -> ReadHeaderResult
+// Parses all of `value` as a decimal number in [min, max]. Prints an error
+// naming `option` otherwise.
+auto parse_number(std::string_view exe, std::string_view option,
+                  std::string_view value, uint64_t min, uint64_t max) noexcept
+	-> std::optional<uint64_t>
 {
-	ReadHeaderResult r{};
-	auto& h = r.header;
-	std::memcpy(&h.base, buffer_data, sizeof(ReplayHeader));
-	if(h.base.type != magic)
-	{
-		std::cerr << exe << ": Not a yrp or yrpX file.\n";
-		return r;
-	}
-	if(h.base.flags & REPLAY_EXTENDED_HEADER)
+	uint64_t n{};
+	auto const* const end = value.data() + value.size();
+	auto const [ptr, ec] = std::from_chars(value.data(), end, n);
+	if(value.empty() || ec != std::errc{} || ptr != end || n < min || n > max)
 	{
-		std::memcpy(&h, buffer_data, sizeof(ExtendedReplayHeader));
-		if(h.header_version > ExtendedReplayHeader::latest_header_version)
-		{
-			std::cerr << exe << ": Replay version is too new.\n";
-			return r;
-		}
+		std::cerr << exe << ": Invalid value '" << value << "' for " << option
+				  << ", expected a number from " << min << " to " << max
+				  << ".\n";
+		return std::nullopt;
 	}
-	r.success = true;
-	return r;
+	return n;
 }
-auto read_replay_contents(std::string_view exe,
-                          ExtendedReplayHeader const& header, std::istream& f,
-                          size_t filesize) noexcept -> std::vector<uint8_t>
+
+constexpr uint64_t MAX_JOBS = 4096U;
+
+struct MetricsArgs
 {
-	auto header_size = (header.base.flags & REPLAY_EXTENDED_HEADER) != 0
-	                       ? sizeof(ExtendedReplayHeader)
-	                       : sizeof(ReplayHeader);
-	f.seekg(0, std::ios_base::beg);
-	f.ignore(header_size);
-	const auto filesize_without_header = filesize - header_size;
-	std::vector<uint8_t> pth_buf(filesize);
-	f.read(reinterpret_cast<char*>(pth_buf.data()), filesize_without_header);
-	if(static_cast<size_t>(f.gcount()) != filesize_without_header)
-	{
-		std::cerr << exe << ": Read error\n";
-		return {};
-	}
-	if(header.base.flags & REPLAY_COMPRESSED)
-	{
-		pth_buf = decompress(exe, header, pth_buf.data(), pth_buf.size(),
-		                     header.base.size);
-		if(pth_buf.size() == 0U)
-			return {}; // NOTE: Error printed by `decompress`.
-	}
-	else if(header.base.size != filesize)
-	{
-		std::cerr << exe << ": File size doesn't match header\n";
-		return {};
-	}
-	return pth_buf;
-}
+	std::optional<std::string_view> path;
+	std::optional<uint16_t> port;
+	bool invalid{}; // An error was printed for one of them.
+};
 
-constexpr auto skip_duelists(uint32_t flags, uint8_t*& ptr) noexcept -> unsigned
+// Takes "--metrics FILE" and "--metrics-port PORT", like the options of
+// `parse_batch_args`.
+auto parse_metrics_arg(std::string_view exe, std::string_view arg, int& a,
+                       int argc, char* argv[], MetricsArgs& metrics) noexcept
+	-> bool
 {
-	unsigned num_duelists = 0;
-	if((flags & REPLAY_SINGLE_MODE) != 0U)
+	if(arg == "--metrics" && a + 1 < argc)
 	{
-		num_duelists += 2;
-		ptr += 40U * num_duelists;
+		metrics.path = std::string_view{argv[++a]};
+		return true;
 	}
-	else
+	if(arg == "--metrics-port" && a + 1 < argc)
 	{
-		num_duelists += read<uint32_t>(ptr);
-		ptr += 40U * num_duelists; // Duelists team 1.
-		auto const t2c = read<uint32_t>(ptr);
-		num_duelists += t2c;
-		ptr += 40U * t2c; // Duelists team 2.
+		auto const port = parse_number(exe, arg, argv[++a], 1U, UINT16_MAX);
+		if(port.has_value())
+			metrics.port = static_cast<uint16_t>(*port);
+		else
+			metrics.invalid = true;
+		return true;
 	}
-	return num_duelists;
-}
-
-constexpr auto read_duel_flags(uint32_t flags,
-                               uint8_t*& ptr) noexcept -> uint64_t
-{
-	if((flags & REPLAY_64BIT_DUELFLAG) != 0U)
-		return read<uint64_t>(ptr);
-	else
-		return static_cast<uint64_t>(read<uint32_t>(ptr));
+	return false;
 }
 
-constexpr auto read_until_decks(uint32_t flags,
-                                uint8_t*& ptr) noexcept -> unsigned
+struct BatchArgs
 {
-	auto const num_duelists = skip_duelists(flags, ptr);
-	ptr += sizeof(uint32_t) * 3; // starting_lp, etc...
-	read_duel_flags(flags, ptr);
-	return num_duelists;
-}
-
-} // namespace
+	unsigned jobs;
+	std::string_view out;
+	std::vector<std::string_view> replays;
+};
 
-auto main(int argc, char* argv[]) -> int
+// Parses "[-j N] OUT REPLAY..." for subcommands that go over a corpus, after
+// `option(arg, a)` had the chance to take `arg`, which is `argv[a]`. It
+// returns whether it did, advancing `a` past any value it takes.
+template<typename Option>
+auto parse_batch_args(std::string_view exe, int argc, char* argv[],
+                      Option&& option) noexcept -> std::optional<BatchArgs>
 {
-	GOOGLE_PROTOBUF_VERIFY_VERSION;
-	struct End
-	{
-		~End() { google::protobuf::ShutdownProtobufLibrary(); }
-	} _;
-	auto const exe = std::string_view{argv[0]};
-	if(argc < 3)
-	{
-		std::cerr << exe << ": No input file or flags.\n";
-		print_usage(exe);
-		return EXIT_FAILURE;
-	}
-	auto const fn = std::string_view{argv[argc - 1]};
-	std::fstream f(fn.data(), IOS_IN);
-	if(!f.is_open())
-	{
-		std::cerr << exe << ": Could not open file '" << fn << "'.\n";
-		return EXIT_FAILURE;
-	}
-	bool print_names_opt = false;
-	bool print_date_opt = false;
-	bool print_decks_opt = false;
-	bool print_duel_seed_opt = false;
-	bool print_duel_options_opt = false;
-	bool print_duel_msgs_opt = false;
-	bool print_duel_resps_opt = false;
-	for(int a = 1; a < argc - 1; a++)
+	BatchArgs args{1U, {}, {}};
+	bool has_out = false;
+	for(int a = 2; a < argc; a++)
 	{
 		auto const arg = std::string_view{argv[a]};
-		if(arg == "--names")
-		{
-			print_names_opt = true;
-			continue;
-		}
-		if(arg == "--date")
-		{
-			print_date_opt = true;
+		if(option(arg, a))
 			continue;
-		}
-		if(arg == "--decks")
+		if((arg == "-j" || arg == "--jobs") && a + 1 < argc)
 		{
-			print_decks_opt = true;
-			continue;
-		}
-		if(arg == "--duel-seed")
-		{
-			print_duel_seed_opt = true;
-			continue;
+			auto const jobs = parse_number(exe, arg, argv[++a], 0U, MAX_JOBS);
+			if(!jobs.has_value())
+				return std::nullopt;
+			args.jobs = static_cast<unsigned>(*jobs);
+			if(args.jobs == 0U)
+				args.jobs = std::max(std::thread::hardware_concurrency(), 1U);
 		}
-		if(arg == "--duel-options")
+		else if(!arg.empty() && arg[0] != '-' && !has_out)
 		{
-			print_duel_options_opt = true;
-			continue;
+			args.out = arg;
+			has_out = true;
 		}
-		if(arg == "--duel-msgs")
+		else if(!arg.empty() && arg[0] != '-')
 		{
-			print_duel_msgs_opt = true;
-			continue;
+			args.replays.emplace_back(arg);
 		}
-		if(arg == "--duel-resps")
+		else
 		{
-			print_duel_resps_opt = true;
-			continue;
+			std::cerr << "Unrecognized option '" << arg << "'.\n";
+			print_usage(exe);
+			return std::nullopt;
 		}
-		std::cerr << "Unrecognized option '" << arg << "'.\n";
-		print_usage(exe);
-		return EXIT_FAILURE;
 	}
-	f.ignore(std::numeric_limits<std::streamsize>::max());
-	const auto filesize = static_cast<size_t>(f.gcount());
-	if(filesize < sizeof(ExtendedReplayHeader))
+	if(!has_out || args.replays.empty())
 	{
-		std::cerr << exe << ": File too small.\n";
-		return EXIT_FAILURE;
+		std::cerr << exe << ": Expected OUT and at least one REPLAY.\n";
+		print_usage(exe);
+		return std::nullopt;
 	}
-	f.clear();
-	auto [read_yrpx_success, yrpx_header] = [&]() -> ReadHeaderResult
+	return args;
+}
+
+struct Options
+{
+	bool print_names{};
+	bool print_date{};
+	bool print_decks{};
+	bool print_duel_seed{};
+	bool print_duel_options{};
+	bool print_duel_msgs{};
+	bool print_duel_resps{};
+	bool print_duel_prompts{};
+	bool print_timeline{};
+	bool print_trajectories{};
+	bool annotate{};
+	bool check_banlist{};
+	std::optional<std::string_view> tensors_dir;
+	std::optional<std::string_view> timeline_dir;
+	std::optional<std::string_view> columns_dir;
+	std::optional<std::string_view> store_dir;
+	std::optional<std::string_view> bundle_dir;
+	CardDb const* card_db{};
+	Banlist const* banlist{};
+	std::function<void()> checkpoint; // See `AnalyzeOptions::checkpoint`.
+};
+
+// Sets the flag of `opts` named by `arg`, if it names one of the flags that
+// only print. Returns whether it did.
+auto parse_print_flag(std::string_view arg, Options& opts) noexcept -> bool
+{
+	std::pair<std::string_view, bool Options::*> const flags[] = {
+		{"--names", &Options::print_names},
+		{"--date", &Options::print_date},
+		{"--decks", &Options::print_decks},
+		{"--duel-seed", &Options::print_duel_seed},
+		{"--duel-options", &Options::print_duel_options},
+		{"--duel-msgs", &Options::print_duel_msgs},
+		{"--duel-resps", &Options::print_duel_resps},
+		{"--duel-prompts", &Options::print_duel_prompts},
+		{"--timeline", &Options::print_timeline},
+		{"--trajectories", &Options::print_trajectories},
+	};
+	for(auto const& [name, flag] : flags)
 	{
-		std::array<uint8_t, sizeof(ExtendedReplayHeader)> header_buffer{};
-		f.seekg(0, std::ios_base::beg);
-		f.read(reinterpret_cast<char*>(header_buffer.data()),
-		       sizeof(ExtendedReplayHeader));
-		return read_header(exe, header_buffer.data(), REPLAY_YRPX);
-	}();
-	if(!read_yrpx_success)
-		return EXIT_FAILURE; // NOTE: Error printed by `read_header`.
-	if((yrpx_header.base.flags & REPLAY_HAND_TEST) != 0)
+		if(arg != name)
+			continue;
+		opts.*flag = true;
+		return true;
+	}
+	return false;
+}
+
+auto process_replay(std::string_view exe, Options const& opts,
+                    std::string_view fn, LoadReplayResult& replay,
+                    std::ostream& out) noexcept -> bool
+{
+	auto& [success, yrpx_header, pth_buf, file_size] = replay;
+	if(!success)
+		return false; // NOTE: Error printed by `load_replay`.
+	if(opts.print_names && !print_names(out, yrpx_header.base.flags,
+	                                    pth_buf.data(), pth_buf.size()))
 	{
-		std::cerr << exe << ": Replay is from hand test mode\n";
-		return EXIT_FAILURE;
+		std::cerr << exe << ": Replay is truncated.\n";
+		return false;
 	}
-	auto pth_buf = read_replay_contents(exe, yrpx_header, f, filesize);
-	if(pth_buf.empty())
-		return EXIT_FAILURE;
-	if(print_names_opt)
-		print_names(yrpx_header.base.flags, pth_buf.data());
-	if(print_date_opt)
-		print_date(yrpx_header.base.seed);
-	if(!print_decks_opt && !print_duel_seed_opt && !print_duel_options_opt &&
-	   !print_duel_msgs_opt && !print_duel_resps_opt)
-		return EXIT_SUCCESS;
+	if(opts.print_date)
+		print_date(out, yrpx_header.base.seed);
+	if(!opts.print_decks && !opts.print_duel_seed && !opts.print_duel_options &&
+	   !opts.print_duel_msgs && !opts.print_duel_resps &&
+	   !opts.print_duel_prompts && !opts.print_timeline &&
+	   !opts.print_trajectories &&
+	   !opts.check_banlist && !opts.tensors_dir.has_value() &&
+	   !opts.timeline_dir.has_value() && !opts.columns_dir.has_value() &&
+	   !opts.store_dir.has_value() && !opts.bundle_dir.has_value())
+		return true;
 	uint64_t duel_flags{};
 	auto ptr_to_msgs = [&, &yrpx_header = yrpx_header]() -> uint8_t*
 	{
 		auto* ptr = pth_buf.data();
-		skip_duelists(yrpx_header.base.flags, ptr);
-		duel_flags = read_duel_flags(yrpx_header.base.flags, ptr);
+		auto const* const sentry = ptr + pth_buf.size();
+		if(!skip_duelists(yrpx_header.base.flags, ptr, sentry))
+			return nullptr;
+		auto const f = read_duel_flags(yrpx_header.base.flags, ptr, sentry);
+		if(!f.has_value())
+			return nullptr;
+		duel_flags = *f;
 		return ptr;
 	}();
+	if(ptr_to_msgs == nullptr)
+	{
+		std::cerr << exe << ": Replay is truncated.\n";
+		return false;
+	}
 	std::optional<AnalyzeResult> analysis;
-	bool const needs_yrp = print_decks_opt || print_duel_seed_opt ||
-	                       print_duel_options_opt || print_duel_resps_opt;
-	bool const needs_analysis = print_duel_msgs_opt || needs_yrp;
+	// NOTE: Message annotations are taken from the cards in the decks.
+	bool const needs_decks = opts.print_decks || opts.check_banlist ||
+	                         (opts.print_duel_msgs && opts.annotate) ||
+	                         opts.bundle_dir.has_value();
+	bool const needs_tensors = opts.tensors_dir.has_value();
+	bool const needs_yrp = needs_decks || needs_tensors ||
+	                       opts.print_duel_seed || opts.print_duel_options ||
+	                       opts.print_duel_resps || opts.print_duel_prompts;
+	bool const needs_timeline = opts.print_timeline ||
+	                            opts.timeline_dir.has_value() ||
+	                            opts.bundle_dir.has_value();
+	bool const needs_analysis = opts.print_duel_msgs || needs_tensors ||
+	                            opts.print_duel_prompts || needs_timeline ||
+	                            opts.print_trajectories ||
+	                            opts.columns_dir.has_value() ||
+	                            opts.store_dir.has_value();
 	if(auto core_version_major = (yrpx_header.base.version >> 16) & 0xff;
 	   (needs_analysis || needs_yrp) && core_version_major < 10)
 	{
 		// with core version 10, the query for card race was changed from 32 bit
 		// to 64 bit, breaking any message using it, drop such replays for now
 		std::cerr << exe << ": Core version for this replay is too old.\n";
-		return EXIT_FAILURE;
+		return false;
 	}
+	uint8_t* orm_buffer = nullptr;
+	size_t orm_size = 0U;
+	size_t const buffer_size = pth_buf.size() - (ptr_to_msgs - pth_buf.data());
 	if(needs_analysis)
 	{
-		size_t buffer_size = pth_buf.size() - (ptr_to_msgs - pth_buf.data());
-		analysis = analyze(exe, ptr_to_msgs, buffer_size);
+		AnalyzeOptions options{};
+		options.serialize_messages = opts.print_duel_msgs;
+		options.serialize_blocks =
+			opts.store_dir.has_value() || opts.bundle_dir.has_value();
+		options.record_decisions = needs_tensors;
+		options.record_prompts = opts.print_duel_prompts;
+		options.record_timeline = needs_timeline;
+		options.record_trajectories = opts.print_trajectories;
+		options.record_columns = opts.columns_dir.has_value();
+		options.record_codes = opts.print_duel_msgs && opts.annotate;
+		options.checkpoint = opts.checkpoint;
+		{
+			StageTimer const timer(Stage::ANALYZE);
+			analysis = analyze(exe, ptr_to_msgs, buffer_size, options);
+		}
 		if(!analysis->success)
-			return EXIT_FAILURE; // NOTE: Error printed by `analyze`.
+			return false; // NOTE: Error printed by `analyze`.
+		orm_buffer = analysis->old_replay_mode_buffer;
+		orm_size = analysis->old_replay_mode_size;
+	}
+	else if(needs_yrp)
+	{
+		// Fast path: only frame the messages to get to the embedded yrp.
+		auto const orm = find_old_replay_mode(exe, ptr_to_msgs, buffer_size);
+		if(!orm.success)
+			return false; // NOTE: Error printed by `find_old_replay_mode`.
+		orm_buffer = orm.old_replay_mode_buffer;
+		orm_size = orm.old_replay_mode_size;
 	}
-	std::optional<ExtendedReplayHeader> yrp_header;
-	std::optional<std::vector<uint8_t>> decompressed_yrp_buffer;
+	StageTimer const output_timer(Stage::OUTPUT);
+	LoadOldReplayResult yrp;
 	if(needs_yrp)
 	{
-		assert(analysis.has_value());
-		if(analysis->old_replay_mode_buffer == nullptr)
+		if(orm_buffer == nullptr)
 		{
 			std::cerr << exe << ": Replay doesn't have OLD_REPLAY_MODE.\n";
-			return EXIT_FAILURE;
+			return false;
 		}
-		if(analysis->old_replay_mode_size < sizeof(ExtendedReplayHeader))
+		yrp = load_old_replay(exe, orm_buffer, orm_size);
+		if(!yrp.success)
+			return false; // NOTE: Error printed by `load_old_replay`.
+	}
+	Decks decks;
+	if(needs_decks)
+	{
+		auto d = read_decks(yrp.header.base.flags, yrp.buffer, yrp.size);
+		if(!d.has_value())
 		{
-			std::cerr << exe << ": Yrp buffer too small.\n";
-			return EXIT_FAILURE;
-		}
-		auto [read_yrp_success, header] =
-			read_header(exe, analysis->old_replay_mode_buffer, REPLAY_YRP1);
-		if(!read_yrp_success)
-			return EXIT_FAILURE; // NOTE: Error printed by `read_header`.
-		yrp_header = header;
-		auto header_size = (header.base.flags & REPLAY_EXTENDED_HEADER) != 0
-		                       ? sizeof(ExtendedReplayHeader)
-		                       : sizeof(ReplayHeader);
-		analysis->old_replay_mode_buffer += header_size;
-		analysis->old_replay_mode_size -= header_size;
-		if((header.base.flags & REPLAY_COMPRESSED) != 0)
-		{
-			decompressed_yrp_buffer =
-				decompress(exe, header, analysis->old_replay_mode_buffer,
-			               analysis->old_replay_mode_size, header.base.size);
-			analysis->old_replay_mode_buffer = decompressed_yrp_buffer->data();
-			analysis->old_replay_mode_size = decompressed_yrp_buffer->size();
-		}
-		else if(analysis->old_replay_mode_size != header.base.size)
-		{
-			std::cerr << exe << ": Yrp buffer size doesn't match header\n";
-			return EXIT_FAILURE;
+			std::cerr << exe << ": Yrp is truncated.\n";
+			return false;
 		}
+		decks = std::move(*d);
 	}
-	if(print_decks_opt)
+	if(opts.print_decks && opts.annotate)
 	{
-		assert(yrp_header.has_value());
-		auto* ptr_to_decks = analysis->old_replay_mode_buffer;
-		auto const num_duelists =
-			read_until_decks(yrp_header->base.flags, ptr_to_decks);
-		using CodeVector = std::vector<uint32_t>;
-		auto read_code_vector = [&ptr_to_decks](CodeVector& cv) noexcept
+		// One card per line: code, type, attribute and name, the latter with
+		// backslashes and control characters escaped.
+		auto print_annotated = [&](std::string_view title, CodeVector const& cv)
 		{
-			auto const size = read<uint32_t>(ptr_to_decks);
-			for(unsigned i = 0; i < size; i++)
-				cv.emplace_back(read<uint32_t>(ptr_to_decks));
+			out << title << '\n';
+			for(auto code : cv)
+			{
+				auto const info = opts.card_db->find(code);
+				out << code << ' ' << (info ? info->type : 0U) << ' '
+					<< (info ? info->attribute : 0U) << ' ';
+				print_escaped_line(out, info ? info->name : "?");
+				out << '\n';
+			}
 		};
-		std::vector<std::pair<CodeVector, CodeVector>> decks;
-		CodeVector extra_cards;
-		decks.reserve(num_duelists);
-		for(auto i = num_duelists; i != 0; i--)
+		for(auto const& deck_pair : decks.duelists)
 		{
-			auto& d = decks.emplace_back();
-			read_code_vector(d.first);  // Main deck
-			read_code_vector(d.second); // Extra deck
+			print_annotated("#main", deck_pair.first);
+			print_annotated("#extra", deck_pair.second);
 		}
-		read_code_vector(extra_cards);
+		print_annotated("#rules", decks.extra_cards);
+	}
+	else if(opts.print_decks)
+	{
 		// Print decks + extra cards
-		for(auto const& deck_pair : decks)
+		for(auto const& deck_pair : decks.duelists)
 		{
-			std::cout << "#main";
+			out << "#main";
 			for(auto code : deck_pair.first)
-				std::cout << ' ' << code;
-			std::cout << " #extra";
+				out << ' ' << code;
+			out << " #extra";
 			for(auto code : deck_pair.second)
-				std::cout << ' ' << code;
-			std::cout << '\n';
-		}
-		std::cout << "#rules";
-		for(auto code : extra_cards)
-			std::cout << ' ' << code;
-		std::cout << '\n';
-	}
-	if(print_duel_seed_opt)
-	{
-		assert(yrp_header.has_value());
-		std::cout << std::hex;
-		auto const& s = yrp_header->seed;
-		std::cout << "Duel seed: 0x" << std::setw(16) << std::setfill('0')
-				  << s[0] << '\'' << std::setw(16) << std::setfill('0') << s[1]
-				  << '\'' << std::setw(16) << std::setfill('0') << s[2] << '\''
-				  << std::setw(16) << std::setfill('0') << s[3] << '\n';
-		std::cout << std::dec;
-	}
-	if(print_duel_options_opt)
-	{
-		assert(yrp_header.has_value());
-		auto* ptr_to_opts = analysis->old_replay_mode_buffer;
-		skip_duelists(yrp_header->base.flags, ptr_to_opts);
-		auto const starting_lp = read<uint32_t>(ptr_to_opts);
-		auto const starting_draw_count = read<uint32_t>(ptr_to_opts);
-		auto const draw_count_per_turn = read<uint32_t>(ptr_to_opts);
-		std::cout << "Duel options: " << starting_lp << ' '
-				  << starting_draw_count << ' ' << draw_count_per_turn << ' '
-				  << duel_flags << '\n';
-	}
-	if(print_duel_msgs_opt)
+				out << ' ' << code;
+			out << '\n';
+		}
+		out << "#rules";
+		for(auto code : decks.extra_cards)
+			out << ' ' << code;
+		out << '\n';
+	}
+	if(opts.check_banlist)
+	{
+		for(size_t i = 0U; i < decks.duelists.size(); i++)
+		{
+			auto const& d = decks.duelists[i];
+			CodeVector codes(d.first);
+			codes.insert(codes.end(), d.second.begin(), d.second.end());
+			for(auto const& v : opts.banlist->check(codes))
+				out << "Banlist violation: duelist " << i << ", card "
+					<< v.code << ", copies " << v.count << ", limit "
+					<< v.limit << '\n';
+		}
+	}
+	if(opts.print_duel_seed)
+	{
+		assert(yrp.success);
+		out << std::hex;
+		auto const& s = yrp.header.seed;
+		out << "Duel seed: 0x" << std::setw(16) << std::setfill('0') << s[0]
+			<< '\'' << std::setw(16) << std::setfill('0') << s[1] << '\''
+			<< std::setw(16) << std::setfill('0') << s[2] << '\''
+			<< std::setw(16) << std::setfill('0') << s[3] << '\n';
+		out << std::dec;
+	}
+	if(opts.print_duel_options)
+	{
+		assert(yrp.success);
+		auto const o =
+			read_duel_options(yrp.header.base.flags, yrp.buffer, yrp.size);
+		if(!o.has_value())
+		{
+			std::cerr << exe << ": Yrp is truncated.\n";
+			return false;
+		}
+		out << "Duel options: " << o->starting_lp << ' '
+			<< o->starting_draw_count << ' ' << o->draw_count_per_turn << ' '
+			<< duel_flags << '\n';
+	}
+	if(opts.print_duel_msgs)
+	{
+		assert(analysis.has_value());
+		out << analysis->duel_messages << '\n';
+	}
+	if(opts.print_duel_msgs && opts.annotate)
+	{
+		// Card dictionary for the codes in the decks and in the messages,
+		// which also have tokens and cards created during the duel.
+		std::vector<uint32_t> codes(analysis->codes);
+		codes.insert(codes.end(), decks.extra_cards.begin(),
+		             decks.extra_cards.end());
+		for(auto const& deck_pair : decks.duelists)
+		{
+			codes.insert(codes.end(), deck_pair.first.begin(),
+			             deck_pair.first.end());
+			codes.insert(codes.end(), deck_pair.second.begin(),
+			             deck_pair.second.end());
+		}
+		std::sort(codes.begin(), codes.end());
+		codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+		out << "{\"cards\":{";
+		auto* pad = "";
+		for(auto code : codes)
+		{
+			auto const info = opts.card_db->find(code);
+			if(!info)
+				continue;
+			out << pad << '"' << code << "\":{\"name\":";
+			pad = ",";
+			print_json_string(out, info->name);
+			out << ",\"type\":" << info->type
+				<< ",\"attribute\":" << info->attribute << '}';
+		}
+		out << "}}\n";
+	}
+	if(needs_tensors)
+	{
+		assert(analysis.has_value() && yrp.success);
+		if(!write_tensors(
+			   exe, output_path(*opts.tensors_dir, fn, ".npy"),
+			   analysis->decisions,
+			   read_responses(yrp.header.base.flags, yrp.buffer, yrp.size)))
+			return false; // NOTE: Error printed by `write_tensors`.
+	}
+	if(opts.print_timeline)
+	{
+		assert(analysis.has_value());
+		print_timeline_json(out, analysis->timeline);
+	}
+	if(opts.print_trajectories)
+	{
+		assert(analysis.has_value());
+		print_trajectories_json(out, analysis->trajectories);
+	}
+	if(opts.timeline_dir.has_value())
+	{
+		assert(analysis.has_value());
+		auto const path = output_path(*opts.timeline_dir, fn, ".erptl");
+		std::ofstream f(path, IOS_OUT);
+		write_timeline_binary(f, analysis->timeline);
+		if(!f)
+		{
+			std::cerr << exe << ": Could not write timeline to '" << path
+					  << "'.\n";
+			return false;
+		}
+	}
+	if(opts.store_dir.has_value())
 	{
 		assert(analysis.has_value());
-		std::cout << analysis->duel_messages << '\n';
-	}
-	if(print_duel_resps_opt)
-	{
-		assert(yrp_header.has_value());
-		auto* ptr_to_resps = analysis->old_replay_mode_buffer;
-		auto const num_duelists =
-			read_until_decks(yrp_header->base.flags, ptr_to_resps);
-		for(auto i = num_duelists; i != 0; i--)
-		{
-			ptr_to_resps += read<uint32_t>(ptr_to_resps) * sizeof(uint32_t);
-			ptr_to_resps += read<uint32_t>(ptr_to_resps) * sizeof(uint32_t);
-		}
-		ptr_to_resps += read<uint32_t>(ptr_to_resps) * sizeof(uint32_t);
-		// Read responses
-		using Response = std::vector<uint8_t>;
-		std::vector<Response> resps;
-		decltype(ptr_to_resps) const sentry =
-			analysis->old_replay_mode_buffer + analysis->old_replay_mode_size;
-		while(sentry != ptr_to_resps)
-		{
-			assert(ptr_to_resps < sentry);
-			auto const size = size_t{read<uint8_t>(ptr_to_resps)};
-			assert(size != 0);
-			auto& resp = resps.emplace_back(size, 0);
-			assert(resp.data() != nullptr);
-			std::memcpy(resp.data(), ptr_to_resps, size);
-			ptr_to_resps += size;
+		auto const path = output_path(*opts.store_dir, fn, ".erpps");
+		std::ofstream f(path, IOS_OUT);
+		write_replay_store(f, analysis->message_blocks);
+		if(!f)
+		{
+			std::cerr << exe << ": Could not write replay store to '" << path
+					  << "'.\n";
+			return false;
+		}
+	}
+	if(opts.bundle_dir.has_value())
+	{
+		assert(analysis.has_value());
+		// NOTE: Names were checked along with the duelists above.
+		BundleInfo const info{
+			*read_names(yrpx_header.base.flags, pth_buf.data(),
+			            pth_buf.size()),
+			yrpx_header.base.seed, decks};
+		if(!write_viewer_bundle(exe, output_path(*opts.bundle_dir, fn, ""), info,
+		                        analysis->timeline, analysis->message_blocks))
+			return false; // NOTE: Error printed by `write_viewer_bundle`.
+	}
+	if(opts.columns_dir.has_value())
+	{
+		assert(analysis.has_value());
+		auto const path = output_path(*opts.columns_dir, fn, ".erpmc");
+		std::ofstream f(path, IOS_OUT);
+		if(!write_message_columns(f, analysis->columns) || !f)
+		{
+			std::cerr << exe << ": Could not write message columns to '"
+					  << path << "'.\n";
+			return false;
 		}
+	}
+	if(opts.print_duel_resps)
+	{
+		assert(yrp.success);
+		auto const resps =
+			read_responses(yrp.header.base.flags, yrp.buffer, yrp.size);
 		// Print responses
-		std::cout << "{\"responses\":[";
+		out << "{\"responses\":[";
 		auto* pad1 = "";
 		for(auto const& resp : resps)
 		{
-			std::cout << pad1 << "[";
+			out << pad1 << "[";
 			pad1 = ",";
 			auto* pad2 = "";
 			for(auto const byte : resp)
 			{
-				std::cout << pad2 << uint32_t{byte};
+				out << pad2 << uint32_t{byte};
+				pad2 = ",";
+			}
+			out << "]";
+		}
+		out << "]}\n";
+	}
+	if(opts.print_duel_prompts)
+	{
+		assert(analysis.has_value() && yrp.success);
+		auto const resps =
+			read_responses(yrp.header.base.flags, yrp.buffer, yrp.size);
+		auto const& prompts = analysis->prompts;
+		// The n-th prompt consumes the n-th response, if any.
+		auto const count = std::max(prompts.msg_index.size(), resps.size());
+		out << "{\"prompts\":[";
+		auto* pad1 = "";
+		for(size_t i = 0U; i < count; i++)
+		{
+			out << pad1 << "{\"msg\":";
+			pad1 = ",";
+			if(i < prompts.msg_index.size())
+				out << prompts.msg_index[i] << ",\"type\":"
+					<< uint32_t{prompts.msg_type[i]};
+			else
+				out << "null,\"type\":null";
+			out << ",\"response\":";
+			if(i >= resps.size())
+			{
+				out << "null}";
+				continue;
+			}
+			out << "[";
+			auto* pad2 = "";
+			for(auto const byte : resps[i])
+			{
+				out << pad2 << uint32_t{byte};
 				pad2 = ",";
 			}
-			std::cout << "]";
+			out << "]}";
+		}
+		out << "]}\n";
+		// NOTE: The duel may end waiting on the last prompt, any other
+		// mismatch is a desync and the pairs above are off from there on.
+		auto const prompt_count = prompts.msg_index.size();
+		if(prompt_count != resps.size() && prompt_count != resps.size() + 1U)
+		{
+			std::cerr << exe << ": Replay has " << prompt_count
+					  << " prompts but " << resps.size() << " responses.\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+auto process_replay(std::string_view exe, Options const& opts,
+                    std::string_view fn, std::ostream& out) noexcept -> bool
+{
+	ERP_PROBE2(replay__start, fn.data(), fn.size());
+	LoadReplayResult replay;
+	{
+		StageTimer const timer(Stage::LOAD);
+		replay = load_replay(exe, fn);
+	}
+	bool const success = process_replay(exe, opts, fn, replay, out);
+	ERP_PROBE1(replay__done, static_cast<int>(success));
+	metrics_replay_done(success, replay.file_size);
+	return success;
+}
+
+// Same as above, for a replay already read into `content`.
+auto process_replay_contents(std::string_view exe, Options const& opts,
+                             std::string_view fn, std::string const& content,
+                             std::ostream& out) noexcept -> bool
+{
+	std::istringstream in(content);
+	ERP_PROBE2(replay__start, fn.data(), fn.size());
+	LoadReplayResult replay;
+	{
+		StageTimer const timer(Stage::LOAD);
+		replay = load_replay(exe, in);
+	}
+	bool const success = process_replay(exe, opts, fn, replay, out);
+	ERP_PROBE1(replay__done, static_cast<int>(success));
+	metrics_replay_done(success, content.size());
+	return success;
+}
+
+} // namespace
+
+auto main(int argc, char* argv[]) -> int
+{
+	auto const exe = std::string_view{argv[0]};
+	if(argc >= 2 && std::string_view{argv[1]} == "compile-card-db")
+	{
+		if(argc != 4)
+		{
+			std::cerr << exe << ": Expected CDB and OUT.\n";
+			print_usage(exe);
+			return EXIT_FAILURE;
+		}
+		return compile_card_db(exe, argv[2], argv[3]) ? EXIT_SUCCESS
+		                                              : EXIT_FAILURE;
+	}
+	if(argc >= 2 && std::string_view{argv[1]} == "diff")
+	{
+		if(argc != 4)
+		{
+			std::cerr << exe << ": Expected A and B.\n";
+			print_usage(exe);
+			return 2;
+		}
+		return diff_replays(exe, argv[2], argv[3]);
+	}
+	if(argc >= 2 && std::string_view{argv[1]} == "export-sqlite")
+	{
+		bool with_messages = false;
+		auto option = [&](std::string_view arg, int& /*a*/)
+		{
+			if(arg != "--messages")
+				return false;
+			with_messages = true;
+			return true;
+		};
+		auto const args = parse_batch_args(exe, argc, argv, option);
+		if(!args.has_value())
+			return EXIT_FAILURE; // NOTE: Error printed by `parse_batch_args`.
+		return export_sqlite(exe, args->out, args->replays, args->jobs,
+		                     with_messages)
+		           ? EXIT_SUCCESS
+		           : EXIT_FAILURE;
+	}
+	if(argc >= 2 && std::string_view{argv[1]} == "anonymize")
+	{
+		std::string salt;
+		std::optional<std::string_view> key_path;
+		auto option = [&](std::string_view arg, int& a)
+		{
+			if(arg == "--salt" && a + 1 < argc)
+			{
+				salt = argv[++a];
+				return true;
+			}
+			if(arg == "--key-file" && a + 1 < argc)
+			{
+				key_path = std::string_view{argv[++a]};
+				return true;
+			}
+			return false;
+		};
+		auto const args = parse_batch_args(exe, argc, argv, option);
+		if(!args.has_value())
+			return EXIT_FAILURE; // NOTE: Error printed by `parse_batch_args`.
+		if(key_path.has_value())
+		{
+			std::ifstream f(std::string{*key_path},
+			                std::ios_base::binary | std::ios_base::in);
+			if(!f.is_open())
+			{
+				std::cerr << exe << ": Could not open file '" << *key_path
+						  << "'.\n";
+				return EXIT_FAILURE;
+			}
+			salt.assign(std::istreambuf_iterator<char>(f),
+			            std::istreambuf_iterator<char>());
+		}
+		return anonymize_replays(exe, args->out, args->replays, args->jobs,
+		                         salt)
+		           ? EXIT_SUCCESS
+		           : EXIT_FAILURE;
+	}
+	if(argc >= 2 && std::string_view{argv[1]} == "compact")
+	{
+		auto no_option = [](std::string_view /*arg*/, int& /*a*/)
+		{ return false; };
+		auto const args = parse_batch_args(exe, argc, argv, no_option);
+		if(!args.has_value())
+			return EXIT_FAILURE; // NOTE: Error printed by `parse_batch_args`.
+		return compact_replays(exe, std::cout, args->out, args->replays,
+		                       args->jobs)
+		           ? EXIT_SUCCESS
+		           : EXIT_FAILURE;
+	}
+	if(argc >= 2 && std::string_view{argv[1]} == "extract-yrp")
+	{
+		bool decompress = false;
+		auto option = [&](std::string_view arg, int& /*a*/)
+		{
+			if(arg != "--decompress")
+				return false;
+			decompress = true;
+			return true;
+		};
+		auto const args = parse_batch_args(exe, argc, argv, option);
+		if(!args.has_value())
+			return EXIT_FAILURE; // NOTE: Error printed by `parse_batch_args`.
+		return extract_yrps(exe, args->out, args->replays, args->jobs,
+		                    decompress)
+		           ? EXIT_SUCCESS
+		           : EXIT_FAILURE;
+	}
+	if(argc >= 2 && std::string_view{argv[1]} == "read-store")
+	{
+		if(argc < 3 || argc > 5)
+		{
+			std::cerr << exe << ": Expected STORE.\n";
+			print_usage(exe);
+			return EXIT_FAILURE;
+		}
+		auto arg_or = [&](int a, std::string_view name,
+		                  uint32_t value) -> std::optional<uint32_t>
+		{
+			if(a >= argc)
+				return value;
+			auto const n = parse_number(exe, name, argv[a], 0U, UINT32_MAX);
+			if(!n.has_value())
+				return std::nullopt;
+			return static_cast<uint32_t>(*n);
+		};
+		auto const first = arg_or(3, "FIRST", 0U);
+		auto const count = arg_or(4, "COUNT", UINT32_MAX);
+		if(!first.has_value() || !count.has_value())
+			return EXIT_FAILURE;
+		ReplayStore store;
+		if(!store.open(exe, argv[2]))
+			return EXIT_FAILURE; // NOTE: Error printed by `ReplayStore::open`.
+		std::vector<std::string> blocks;
+		if(!store.read(exe, *first, *count, blocks))
+			return EXIT_FAILURE; // NOTE: Error printed by `ReplayStore::read`.
+		auto const json = blocks_to_json(blocks);
+		if(!json.has_value())
+		{
+			std::cerr << exe << ": Replay store has corrupted messages.\n";
+			return EXIT_FAILURE;
+		}
+		std::cout << *json << '\n';
+		return EXIT_SUCCESS;
+	}
+	if(argc >= 2 && std::string_view{argv[1]} == "serve")
+	{
+		std::optional<std::string_view> card_db_path;
+		std::optional<std::string_view> socket_path;
+		ServeOptions options{std::max(std::thread::hardware_concurrency(), 1U),
+		                     0U, 0U};
+		size_t cache_mib = 256U;
+		MetricsArgs metrics;
+		for(int a = 2; a < argc; a++)
+		{
+			auto const arg = std::string_view{argv[a]};
+			if(parse_metrics_arg(exe, arg, a, argc, argv, metrics))
+				continue;
+			// NOTE: Numbers are checked as they are taken, `n` holds each.
+			std::optional<uint64_t> n;
+			if(arg == "--card-db" && a + 1 < argc)
+				card_db_path = std::string_view{argv[++a]};
+			else if(arg == "--cache-size" && a + 1 < argc)
+			{
+				if(!(n = parse_number(exe, arg, argv[++a], 0U,
+				                      SIZE_MAX >> 20U)))
+					return EXIT_FAILURE;
+				cache_mib = static_cast<size_t>(*n);
+			}
+			else if((arg == "-j" || arg == "--jobs") && a + 1 < argc)
+			{
+				if(!(n = parse_number(exe, arg, argv[++a], 0U, MAX_JOBS)))
+					return EXIT_FAILURE;
+				options.jobs = std::max(static_cast<unsigned>(*n), 1U);
+			}
+			else if(arg == "--client-jobs" && a + 1 < argc)
+			{
+				if(!(n = parse_number(exe, arg, argv[++a], 0U, MAX_JOBS)))
+					return EXIT_FAILURE;
+				options.client_jobs = static_cast<unsigned>(*n);
+			}
+			else if(!arg.empty() && arg[0] != '-' && !socket_path.has_value())
+				socket_path = arg;
+			else
+			{
+				std::cerr << "Unrecognized option '" << arg << "'.\n";
+				print_usage(exe);
+				return EXIT_FAILURE;
+			}
+		}
+		if(metrics.invalid)
+			return EXIT_FAILURE; // NOTE: Error printed by `parse_number`.
+		if(!socket_path.has_value())
+		{
+			std::cerr << exe << ": Expected SOCKET.\n";
+			print_usage(exe);
+			return EXIT_FAILURE;
+		}
+		Options base;
+		CardDb card_db;
+		if(card_db_path.has_value())
+		{
+			if(!card_db.open(exe, *card_db_path))
+				return EXIT_FAILURE; // NOTE: Error printed by `CardDb::open`.
+			base.card_db = &card_db;
+			base.annotate = true;
+		}
+		// NOTE: Only flags that print are taken from requests, the daemon
+		// must not write files on behalf of its clients.
+		auto handler = [&](std::string_view prefixed_exe,
+		                   std::vector<std::string_view> const& args,
+		                   std::string_view fn, std::string const& content,
+		                   std::function<void()> const& checkpoint,
+		                   std::ostream& out) -> bool
+		{
+			Options opts = base;
+			opts.checkpoint = checkpoint;
+			for(auto const arg : args)
+			{
+				if(parse_print_flag(arg, opts))
+					continue;
+				std::cerr << prefixed_exe << ": Unrecognized option '" << arg
+						  << "'.\n";
+				return false;
+			}
+			return process_replay_contents(prefixed_exe, opts, fn, content,
+			                               out);
+		};
+		// NOTE: 0 leaves clients unrestricted.
+		if(options.client_jobs == 0U)
+			options.client_jobs = options.jobs;
+		options.cache_bytes = cache_mib * 1024U * 1024U;
+		MetricsExporter exporter;
+		if(!exporter.start(exe, metrics.path, metrics.port))
+			return EXIT_FAILURE; // NOTE: Error printed by `start`.
+		return serve(exe, *socket_path, options, handler)
+		           ? EXIT_SUCCESS
+		           : EXIT_FAILURE;
+	}
+	if(argc >= 2 && std::string_view{argv[1]} == "ingest")
+	{
+		Options opts;
+		std::optional<std::string_view> card_db_path;
+		std::optional<std::string_view> ring_path;
+		size_t ring_mib = 64U;
+		unsigned jobs = std::max(std::thread::hardware_concurrency(), 1U);
+		MetricsArgs metrics;
+		for(int a = 2; a < argc; a++)
+		{
+			auto const arg = std::string_view{argv[a]};
+			if(parse_print_flag(arg, opts) ||
+			   parse_metrics_arg(exe, arg, a, argc, argv, metrics))
+				continue;
+			std::optional<uint64_t> n;
+			if(arg == "--card-db" && a + 1 < argc)
+				card_db_path = std::string_view{argv[++a]};
+			else if(arg == "--ring-size" && a + 1 < argc)
+			{
+				if(!(n = parse_number(exe, arg, argv[++a], 0U,
+				                      SIZE_MAX >> 20U)))
+					return EXIT_FAILURE;
+				ring_mib = static_cast<size_t>(*n);
+			}
+			else if((arg == "-j" || arg == "--jobs") && a + 1 < argc)
+			{
+				if(!(n = parse_number(exe, arg, argv[++a], 0U, MAX_JOBS)))
+					return EXIT_FAILURE;
+				jobs = std::max(static_cast<unsigned>(*n), 1U);
+			}
+			else if(!arg.empty() && arg[0] != '-' && !ring_path.has_value())
+				ring_path = arg;
+			else
+			{
+				std::cerr << "Unrecognized option '" << arg << "'.\n";
+				print_usage(exe);
+				return EXIT_FAILURE;
+			}
+		}
+		if(metrics.invalid)
+			return EXIT_FAILURE; // NOTE: Error printed by `parse_number`.
+		if(!ring_path.has_value())
+		{
+			std::cerr << exe << ": Expected RING.\n";
+			print_usage(exe);
+			return EXIT_FAILURE;
+		}
+		CardDb card_db;
+		if(card_db_path.has_value())
+		{
+			if(!card_db.open(exe, *card_db_path))
+				return EXIT_FAILURE; // NOTE: Error printed by `CardDb::open`.
+			opts.card_db = &card_db;
+			opts.annotate = true;
+		}
+		IngestRing ring;
+		if(!ring.create(exe, *ring_path, ring_mib * 1024U * 1024U))
+			return EXIT_FAILURE; // NOTE: Error printed by `IngestRing::create`.
+		MetricsExporter exporter;
+		if(!exporter.start(exe, metrics.path, metrics.port))
+			return EXIT_FAILURE; // NOTE: Error printed by `start`.
+		auto handler = [&](std::string_view prefixed_exe, uint64_t seq,
+		                   std::string const& content,
+		                   std::ostream& out) -> bool
+		{
+			return process_replay_contents(prefixed_exe, opts,
+			                               '#' + std::to_string(seq), content,
+			                               out);
+		};
+		return consume_ring(exe, ring, jobs, handler, std::cout)
+		           ? EXIT_SUCCESS
+		           : EXIT_FAILURE;
+	}
+	if(argc >= 2 && std::string_view{argv[1]} == "ring-push")
+	{
+		bool close = false;
+		std::vector<std::string_view> args;
+		for(int a = 2; a < argc; a++)
+		{
+			if(std::string_view{argv[a]} == "--close")
+				close = true;
+			else
+				args.emplace_back(argv[a]);
+		}
+		if(args.empty())
+		{
+			std::cerr << exe << ": Expected RING.\n";
+			print_usage(exe);
+			return EXIT_FAILURE;
+		}
+		return push_replay_files(exe, args[0], {args.begin() + 1, args.end()},
+		                         close)
+		           ? EXIT_SUCCESS
+		           : EXIT_FAILURE;
+	}
+	if(argc < 3)
+	{
+		std::cerr << exe << ": No input file or flags.\n";
+		print_usage(exe);
+		return EXIT_FAILURE;
+	}
+	Options opts;
+	std::optional<std::string_view> card_db_path;
+	std::optional<std::string_view> banlist_path;
+	std::optional<std::string_view> compress_spec;
+	std::string_view compress_dict_path;
+	unsigned jobs = 1U;
+	std::vector<std::string_view> replays;
+	MetricsArgs metrics;
+	for(int a = 1; a < argc; a++)
+	{
+		auto const arg = std::string_view{argv[a]};
+		if(parse_print_flag(arg, opts) ||
+		   parse_metrics_arg(exe, arg, a, argc, argv, metrics))
+			continue;
+		if(arg == "--card-db" && a + 1 < argc)
+		{
+			card_db_path = std::string_view{argv[++a]};
+			continue;
+		}
+		if(arg == "--check-banlist" && a + 1 < argc)
+		{
+			banlist_path = std::string_view{argv[++a]};
+			continue;
+		}
+		if(arg == "--export-tensors" && a + 1 < argc)
+		{
+			opts.tensors_dir = std::string_view{argv[++a]};
+			continue;
+		}
+		if(arg == "--compress" && a + 1 < argc)
+		{
+			compress_spec = std::string_view{argv[++a]};
+			continue;
+		}
+		if(arg == "--compress-dict" && a + 1 < argc)
+		{
+			compress_dict_path = std::string_view{argv[++a]};
+			continue;
+		}
+		if(arg == "--export-store" && a + 1 < argc)
+		{
+			opts.store_dir = std::string_view{argv[++a]};
+			continue;
+		}
+		if(arg == "--viewer-bundle" && a + 1 < argc)
+		{
+			opts.bundle_dir = std::string_view{argv[++a]};
+			continue;
+		}
+		if(arg == "--export-columns" && a + 1 < argc)
+		{
+			opts.columns_dir = std::string_view{argv[++a]};
+			continue;
+		}
+		if(arg == "--export-timeline" && a + 1 < argc)
+		{
+			opts.timeline_dir = std::string_view{argv[++a]};
+			continue;
+		}
+		if((arg == "-j" || arg == "--jobs") && a + 1 < argc)
+		{
+			auto const n = parse_number(exe, arg, argv[++a], 0U, MAX_JOBS);
+			if(!n.has_value())
+				return EXIT_FAILURE;
+			jobs = static_cast<unsigned>(*n);
+			if(jobs == 0U)
+				jobs = std::max(std::thread::hardware_concurrency(), 1U);
+			continue;
 		}
-		std::cout << "]}\n";
+		if(!arg.empty() && arg[0] != '-')
+		{
+			replays.emplace_back(arg);
+			continue;
+		}
+		std::cerr << "Unrecognized option '" << arg << "'.\n";
+		print_usage(exe);
+		return EXIT_FAILURE;
+	}
+	if(metrics.invalid)
+		return EXIT_FAILURE; // NOTE: Error printed by `parse_number`.
+	if(replays.empty())
+	{
+		std::cerr << exe << ": No input file.\n";
+		print_usage(exe);
+		return EXIT_FAILURE;
 	}
-	return EXIT_SUCCESS;
+	CardDb card_db;
+	if(card_db_path.has_value())
+	{
+		if(!card_db.open(exe, *card_db_path))
+			return EXIT_FAILURE; // NOTE: Error printed by `CardDb::open`.
+		opts.card_db = &card_db;
+		opts.annotate = true;
+	}
+	Banlist banlist;
+	if(banlist_path.has_value())
+	{
+		if(!banlist.load(exe, *banlist_path))
+			return EXIT_FAILURE; // NOTE: Error printed by `Banlist::load`.
+		opts.banlist = &banlist;
+		opts.check_banlist = true;
+	}
+	// NOTE: Other codecs given a dictionary are rejected by `open`.
+	if(!compress_dict_path.empty() && !compress_spec.has_value())
+	{
+		std::cerr << exe << ": --compress-dict needs --compress zstd.\n";
+		return EXIT_FAILURE;
+	}
+	OutputCompressor compressor;
+	if(compress_spec.has_value() &&
+	   !compressor.open(exe, *compress_spec, compress_dict_path))
+		return EXIT_FAILURE; // NOTE: Error printed by `OutputCompressor::open`.
+	MetricsExporter exporter;
+	if(!exporter.start(exe, metrics.path, metrics.port))
+		return EXIT_FAILURE; // NOTE: Error printed by `start`.
+	// NOTE: Output is only counted when buffered.
+	if(replays.size() == 1U && !compressor.enabled() &&
+	   !metrics.path.has_value() && !metrics.port.has_value())
+		return process_replay(exe, opts, replays[0], std::cout) ? EXIT_SUCCESS
+		                                                        : EXIT_FAILURE;
+	// Replays are parsed in parallel, their output is buffered (and
+	// compressed) and then written in the same order they were given.
+	struct Result
+	{
+		bool success;
+		std::string output;
+	};
+	bool all_success = true;
+	parallel_ordered(
+		replays.size(), jobs,
+		[&](size_t i) -> Result
+		{
+			auto const fn = replays[i];
+			auto const prefixed_exe =
+				replays.size() == 1U ? std::string{exe}
+									 : std::string{exe} + ": " + std::string{fn};
+			std::ostringstream out;
+			if(replays.size() != 1U)
+				out << "==> " << fn << " <==\n";
+			bool success = process_replay(prefixed_exe, opts, fn, out);
+			if(!compressor.enabled())
+				return {success, out.str()};
+			std::string compressed;
+			success = compressor.compress(prefixed_exe, out.str(), compressed) &&
+			          success;
+			return {success, std::move(compressed)};
+		},
+		[&](size_t /*i*/, Result&& r)
+		{
+			all_success = all_success && r.success;
+			metrics_bytes_out(r.output.size());
+			std::cout << r.output;
+		});
+	return all_success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "message_columns.hpp"
+
+#include <algorithm> // std::min, std::sort, std::unique, std::lower_bound
+#include <cstring>   // std::memcpy
+#include <limits>
+#include <lzma.h>
+#include <ostream>
+#include <string_view>
+
+namespace
+{
+
+#include "read.inl"
+
+// NOTE: Core message numbers as used by edo9300's ocgcore.
+constexpr uint8_t MSG_MOVE = 50U;
+constexpr uint8_t MSG_POS_CHANGE = 53U;
+constexpr uint8_t MSG_SET = 54U;
+constexpr uint8_t MSG_SWAP = 55U;
+constexpr uint8_t MSG_SUMMONING = 60U;
+constexpr uint8_t MSG_SPSUMMONING = 62U;
+constexpr uint8_t MSG_FLIPSUMMONING = 64U;
+constexpr uint8_t MSG_CHAINING = 70U;
+constexpr uint8_t MSG_DRAW = 90U;
+
+constexpr uint8_t LOCATION_HAND = 0x02U;
+
+constexpr uint32_t NO_CONTROLLER = 0xFFU;
+
+constexpr uint32_t BLOCK_ROWS = 65536U;
+constexpr size_t MAX_DICTIONARY_SIZE = 256U;
+// NOTE: Dictionary indices are repetitive enough that higher presets barely
+// help, while being much slower.
+constexpr uint32_t XZ_PRESET = 1U;
+
+struct Column
+{
+	std::string_view name;
+	uint8_t width;
+};
+
+constexpr std::array<Column, MessageColumns::COLUMN_COUNT> COLUMNS{{
+	{"msg", 4U},
+	{"type", 1U},
+	{"turn", 2U},
+	{"controller", 1U},
+	{"location", 1U},
+	{"sequence", 4U},
+	{"code", 4U},
+}};
+
+auto put_le(std::vector<uint8_t>& out, uint32_t value, uint8_t width) noexcept
+	-> void
+{
+	// NOTE: Values that do not fit are saturated.
+	auto const max = width >= 4U ? std::numeric_limits<uint32_t>::max()
+	                             : (uint32_t{1U} << (8U * width)) - 1U;
+	value = std::min(value, max);
+	for(uint8_t i = 0U; i < width; i++)
+		out.push_back(static_cast<uint8_t>((value >> (8U * i)) & 0xFFU));
+}
+
+// Dictionary encodes the values if they have few distinct ones.
+auto encode_chunk(uint32_t const* values, size_t count,
+                  uint8_t width) noexcept -> std::vector<uint8_t>
+{
+	std::vector<uint32_t> dict(values, values + count);
+	std::sort(dict.begin(), dict.end());
+	dict.erase(std::unique(dict.begin(), dict.end()), dict.end());
+	std::vector<uint8_t> out;
+	if(dict.size() > MAX_DICTIONARY_SIZE)
+	{
+		out.reserve(1U + (count * width));
+		out.push_back(0U);
+		for(size_t i = 0U; i < count; i++)
+			put_le(out, values[i], width);
+		return out;
+	}
+	out.reserve(1U + 2U + (dict.size() * width) + count);
+	out.push_back(1U);
+	put_le(out, static_cast<uint32_t>(dict.size()), 2U);
+	for(auto const value : dict)
+		put_le(out, value, width);
+	for(size_t i = 0U; i < count; i++)
+	{
+		auto const it = std::lower_bound(dict.begin(), dict.end(), values[i]);
+		out.push_back(static_cast<uint8_t>(it - dict.begin()));
+	}
+	return out;
+}
+
+auto compress_chunk(std::vector<uint8_t> const& in,
+                    std::vector<uint8_t>& out) noexcept -> bool
+{
+	out.resize(lzma_stream_buffer_bound(in.size()));
+	size_t out_pos = 0U;
+	if(lzma_easy_buffer_encode(XZ_PRESET, LZMA_CHECK_CRC32, nullptr,
+	                           in.data(), in.size(), out.data(), &out_pos,
+	                           out.size()) != LZMA_OK)
+		return false;
+	out.resize(out_pos);
+	return true;
+}
+
+} // namespace
+
+auto MessageColumns::append(uint32_t msg_index, uint32_t turn,
+                            uint8_t msg_type, uint8_t const* data,
+                            size_t size) noexcept -> void
+{
+	uint32_t con = NO_CONTROLLER;
+	uint32_t loc = 0U;
+	uint32_t seq = 0U;
+	uint32_t code = 0U;
+	switch(msg_type)
+	{
+	case MSG_MOVE:
+	case MSG_SET:
+	case MSG_SWAP:
+	case MSG_SUMMONING:
+	case MSG_SPSUMMONING:
+	case MSG_FLIPSUMMONING:
+	case MSG_CHAINING:
+	{
+		// code (4) + controller (1) + location (1) + sequence (4) + ...
+		if(size < 4U + 1U + 1U + 4U)
+			break;
+		code = read<uint32_t>(data);
+		con = read<uint8_t>(data) & 1U;
+		loc = read<uint8_t>(data);
+		seq = read<uint32_t>(data);
+		break;
+	}
+	case MSG_POS_CHANGE:
+	{
+		if(size < 4U + 1U + 1U + 1U)
+			break;
+		code = read<uint32_t>(data);
+		con = read<uint8_t>(data) & 1U;
+		loc = read<uint8_t>(data);
+		seq = read<uint8_t>(data);
+		break;
+	}
+	case MSG_DRAW:
+	{
+		// NOTE: Only the first card drawn.
+		if(size < 1U + 4U + 4U)
+			break;
+		con = read<uint8_t>(data) & 1U;
+		loc = LOCATION_HAND;
+		if(read<uint32_t>(data) != 0U)
+			code = read<uint32_t>(data);
+		break;
+	}
+	default:
+		break;
+	}
+	auto* c = columns.data();
+	auto put = [&c](uint32_t value) { (c++)->push_back(value); };
+	put(msg_index);
+	put(msg_type);
+	put(turn);
+	put(con);
+	put(loc);
+	put(seq);
+	put(code);
+}
+
+auto write_message_columns(std::ostream& out,
+                           MessageColumns const& mc) noexcept -> bool
+{
+	std::vector<uint8_t> header;
+	auto const rows = static_cast<uint32_t>(mc.columns[0].size());
+	header.insert(header.end(), {'E', 'R', 'P', 'M', 'C', '0', '0', '1'});
+	put_le(header, rows, 4U);
+	put_le(header, static_cast<uint32_t>(MessageColumns::COLUMN_COUNT), 4U);
+	put_le(header, BLOCK_ROWS, 4U);
+	for(auto const& c : COLUMNS)
+	{
+		header.push_back(static_cast<uint8_t>(c.name.size()));
+		header.insert(header.end(), c.name.begin(), c.name.end());
+		header.push_back(c.width);
+	}
+	out.write(reinterpret_cast<char const*>(header.data()), header.size());
+	std::vector<uint8_t> chunk;
+	for(uint32_t first = 0U; first < rows; first += BLOCK_ROWS)
+	{
+		auto const count = std::min(rows - first, BLOCK_ROWS);
+		for(size_t i = 0U; i < MessageColumns::COLUMN_COUNT; i++)
+		{
+			if(!compress_chunk(encode_chunk(mc.columns[i].data() + first,
+			                                count, COLUMNS[i].width),
+			                   chunk))
+				return false;
+			std::array<char, 4U> size{};
+			for(size_t b = 0U; b < size.size(); b++)
+				size[b] = static_cast<char>((chunk.size() >> (8U * b)) & 0xFFU);
+			out.write(size.data(), size.size());
+			out.write(reinterpret_cast<char const*>(chunk.data()),
+			          chunk.size());
+		}
+	}
+	return true;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_MESSAGE_COLUMNS_HPP
+#define ERP_MESSAGE_COLUMNS_HPP
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+// The common fields of every duel message, stored one column per field.
+// Columns, in order:
+//   msg         Index in the message stream.
+//   type        Core message number.
+//   turn
+//   controller, location, sequence, code
+//               First card the message is about, for the messages whose core
+//               record starts with one (moves, sets, summons, chaining, ...).
+//               Otherwise controller is 0xFF and the rest 0.
+struct MessageColumns
+{
+	static constexpr size_t COLUMN_COUNT = 7U;
+
+	std::array<std::vector<uint32_t>, COLUMN_COUNT> columns;
+
+	auto append(uint32_t msg_index, uint32_t turn, uint8_t msg_type,
+	            uint8_t const* data, size_t size) noexcept -> void;
+};
+
+// Little endian binary layout:
+//   char[8]  "ERPMC001"
+//   uint32   Number of rows.
+//   uint32   Number of columns.
+//   uint32   Rows per block, all blocks but the last are full.
+//   Per column: uint8 name length, name, uint8 value width in bytes.
+//   Per block, per column: uint32 size, then that many bytes of an xz stream
+//   that decompresses to:
+//     uint8  0 for plain, the values of the block at the column's width.
+//            1 for dictionary, uint16 entry count, the entries at the
+//            column's width, then a uint8 entry index per value.
+// Returns false if a block could not be compressed.
+auto write_message_columns(std::ostream& out,
+                           MessageColumns const& mc) noexcept -> bool;
+
+#endif // ERP_MESSAGE_COLUMNS_HPP
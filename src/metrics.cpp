@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring> // std::strerror
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <shared_mutex>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "probes.hpp"
+
+namespace
+{
+
+constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::COUNT);
+constexpr std::array<std::string_view, STAGE_COUNT> STAGE_NAMES{
+	"load", "analyze", "output"};
+// Upper bounds of the latency buckets, in seconds.
+constexpr std::array<double, 16U> BUCKETS{
+	0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+	0.05,   0.1,     0.25,   0.5,   1.0,    2.5,   5.0,  10.0};
+constexpr auto FILE_INTERVAL = std::chrono::seconds(10);
+
+struct Block
+{
+	using Counter = std::atomic<uint64_t>;
+
+	Counter replays;
+	std::array<Counter, STAGE_COUNT> failed;
+	Counter bytes_in;
+	Counter bytes_out;
+	// Per stage: a count per bucket (not cumulative) plus one for the rest.
+	std::array<std::array<Counter, BUCKETS.size() + 1U>, STAGE_COUNT> buckets;
+	std::array<Counter, STAGE_COUNT> nanoseconds;
+
+	// NOTE: Only the owning thread writes, so there is no need for an atomic
+	// read-modify-write, just for readers not to see torn values.
+	static auto add(Counter& c, uint64_t n) noexcept -> void
+	{
+		c.store(c.load(std::memory_order_relaxed) + n,
+		        std::memory_order_relaxed);
+	}
+
+	auto merge_into(Block& total) const noexcept -> void
+	{
+		auto sum = [](Counter& to, Counter const& from)
+		{ to.fetch_add(from.load(std::memory_order_relaxed)); };
+		sum(total.replays, replays);
+		sum(total.bytes_in, bytes_in);
+		sum(total.bytes_out, bytes_out);
+		for(size_t s = 0U; s < STAGE_COUNT; s++)
+		{
+			sum(total.failed[s], failed[s]);
+			sum(total.nanoseconds[s], nanoseconds[s]);
+			for(size_t b = 0U; b < buckets[s].size(); b++)
+				sum(total.buckets[s][b], buckets[s][b]);
+		}
+	}
+};
+
+struct Value
+{
+	std::string name;
+	std::string help;
+	std::string type;
+	std::function<double()> read;
+};
+
+struct Registry
+{
+	std::mutex mtx;
+	std::vector<Block*> live;
+	Block retired{}; // What threads that ended had counted.
+	// NOTE: Readers take other locks (cache shards, the scheduler), so they
+	// are called without `mtx`. Scrapes share this lock while calling them
+	// and removing a value waits for those to end, as what it reads from is
+	// about to go away.
+	std::shared_mutex values_mtx;
+	std::vector<Value> values;
+};
+
+auto registry() noexcept -> Registry&
+{
+	static Registry r;
+	return r;
+}
+
+// Registers the thread's block on first use and folds it into `retired`
+// when the thread ends.
+struct ThreadBlock
+{
+	std::unique_ptr<Block> block = std::make_unique<Block>();
+	Stage stage = Stage::LOAD;
+
+	ThreadBlock() noexcept
+	{
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mtx);
+		r.live.push_back(block.get());
+	}
+
+	~ThreadBlock() noexcept
+	{
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mtx);
+		block->merge_into(r.retired);
+		r.live.erase(std::find(r.live.begin(), r.live.end(), block.get()));
+	}
+};
+
+auto thread_block() noexcept -> ThreadBlock&
+{
+	thread_local ThreadBlock tb;
+	return tb;
+}
+
+auto write_all(int fd, std::string_view data) noexcept -> void
+{
+	while(!data.empty())
+	{
+		auto const n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+		if(n == -1 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return;
+		data.remove_prefix(static_cast<size_t>(n));
+	}
+}
+
+} // namespace
+
+StageTimer::StageTimer(Stage stage) noexcept
+	: stage_(stage), start_(std::chrono::steady_clock::now())
+{
+	thread_block().stage = stage;
+	ERP_PROBE1(stage__start, static_cast<int>(stage));
+}
+
+StageTimer::~StageTimer() noexcept
+{
+	auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+						std::chrono::steady_clock::now() - start_)
+	                    .count();
+	ERP_PROBE2(stage__done, static_cast<int>(stage_), static_cast<int64_t>(ns));
+	auto const seconds = static_cast<double>(ns) / 1e9;
+	auto const bucket = static_cast<size_t>(
+		std::lower_bound(BUCKETS.begin(), BUCKETS.end(), seconds) -
+		BUCKETS.begin());
+	auto& block = *thread_block().block;
+	auto const s = static_cast<size_t>(stage_);
+	Block::add(block.buckets[s][bucket], 1U);
+	Block::add(block.nanoseconds[s], static_cast<uint64_t>(ns));
+}
+
+auto metrics_replay_done(bool success, uint64_t bytes_in) noexcept -> void
+{
+	auto& tb = thread_block();
+	if(success)
+		Block::add(tb.block->replays, 1U);
+	else
+		Block::add(tb.block->failed[static_cast<size_t>(tb.stage)], 1U);
+	Block::add(tb.block->bytes_in, bytes_in);
+	tb.stage = Stage::LOAD;
+}
+
+auto metrics_bytes_out(uint64_t bytes) noexcept -> void
+{
+	Block::add(thread_block().block->bytes_out, bytes);
+}
+
+auto metrics_add_value(std::string name, std::string help, std::string type,
+                       std::function<double()> read) noexcept -> void
+{
+	auto& r = registry();
+	std::unique_lock<std::shared_mutex> lock(r.values_mtx);
+	r.values.push_back(
+		{std::move(name), std::move(help), std::move(type), std::move(read)});
+}
+
+auto metrics_remove_values(std::string_view prefix) noexcept -> void
+{
+	auto& r = registry();
+	std::unique_lock<std::shared_mutex> lock(r.values_mtx);
+	r.values.erase(std::remove_if(r.values.begin(), r.values.end(),
+	                              [&](Value const& v) {
+									  return std::string_view{v.name}.substr(
+												 0U, prefix.size()) == prefix;
+								  }),
+	               r.values.end());
+}
+
+auto print_metrics(std::ostream& out) noexcept -> void
+{
+	auto& r = registry();
+	Block total{};
+	{
+		std::lock_guard<std::mutex> lock(r.mtx);
+		r.retired.merge_into(total);
+		for(auto const* block : r.live)
+			block->merge_into(total);
+	}
+	auto header = [&](std::string_view name, std::string_view help,
+	                  std::string_view type)
+	{
+		out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' '
+			<< type << '\n';
+	};
+	header("erp_replays_total", "Replays processed successfully.", "counter");
+	out << "erp_replays_total " << total.replays << '\n';
+	header("erp_replays_failed_total",
+	       "Replays that failed, by the stage they failed in.", "counter");
+	for(size_t s = 0U; s < STAGE_COUNT; s++)
+		out << "erp_replays_failed_total{stage=\"" << STAGE_NAMES[s] << "\"} "
+			<< total.failed[s] << '\n';
+	header("erp_bytes_in_total", "Bytes of replays read.", "counter");
+	out << "erp_bytes_in_total " << total.bytes_in << '\n';
+	header("erp_bytes_out_total", "Bytes of output produced.", "counter");
+	out << "erp_bytes_out_total " << total.bytes_out << '\n';
+	header("erp_stage_duration_seconds", "Time spent in each stage.",
+	       "histogram");
+	for(size_t s = 0U; s < STAGE_COUNT; s++)
+	{
+		auto const label = "{stage=\"" + std::string{STAGE_NAMES[s]} + '"';
+		uint64_t cumulative = 0U;
+		for(size_t b = 0U; b <= BUCKETS.size(); b++)
+		{
+			cumulative += total.buckets[s][b];
+			out << "erp_stage_duration_seconds_bucket" << label << ",le=\"";
+			if(b == BUCKETS.size())
+				out << "+Inf";
+			else
+				out << BUCKETS[b];
+			out << "\"} " << cumulative << '\n';
+		}
+		out << "erp_stage_duration_seconds_sum" << label << "} "
+			<< static_cast<double>(total.nanoseconds[s]) / 1e9 << '\n'
+			<< "erp_stage_duration_seconds_count" << label << "} "
+			<< cumulative << '\n';
+	}
+	std::shared_lock<std::shared_mutex> lock(r.values_mtx);
+	for(auto const& v : r.values)
+	{
+		header(v.name, v.help, v.type);
+		out << v.name << ' ' << v.read() << '\n';
+	}
+}
+
+MetricsExporter::~MetricsExporter() noexcept
+{
+	if(thread_.joinable())
+	{
+		uint64_t const one = 1U;
+		[[maybe_unused]] auto const n = write(stop_fd_, &one, sizeof(one));
+		thread_.join();
+	}
+	if(listen_fd_ != -1)
+		close(listen_fd_);
+	if(stop_fd_ != -1)
+		close(stop_fd_);
+}
+
+auto MetricsExporter::start(std::string_view exe,
+                            std::optional<std::string_view> path,
+                            std::optional<uint16_t> port) noexcept -> bool
+{
+	if(!path.has_value() && !port.has_value())
+		return true;
+	exe_ = exe;
+	path_ = path.value_or("");
+	if(port.has_value())
+	{
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(*port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		int const one = 1;
+		listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(listen_fd_ == -1 ||
+		   setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one,
+		              sizeof(one)) != 0 ||
+		   bind(listen_fd_, reinterpret_cast<sockaddr const*>(&addr),
+		        sizeof(addr)) != 0 ||
+		   listen(listen_fd_, 16) != 0)
+		{
+			std::cerr << exe << ": Could not listen for metrics on port "
+					  << *port << ": " << std::strerror(errno) << ".\n";
+			return false;
+		}
+	}
+	stop_fd_ = eventfd(0U, EFD_CLOEXEC);
+	if(stop_fd_ == -1)
+	{
+		std::cerr << exe << ": Could not start metrics exporter.\n";
+		return false;
+	}
+	thread_ = std::thread(
+		[this]()
+		{
+			auto next_write = std::chrono::steady_clock::now();
+			for(;;)
+			{
+				if(!path_.empty() &&
+				   std::chrono::steady_clock::now() >= next_write)
+				{
+					write_file();
+					next_write += FILE_INTERVAL;
+				}
+				std::array<pollfd, 2U> fds{{{stop_fd_, POLLIN, 0},
+				                            {listen_fd_, POLLIN, 0}}};
+				auto const count = listen_fd_ == -1 ? 1U : 2U;
+				if(poll(fds.data(), count, 1000) == -1 && errno != EINTR)
+					break;
+				if(fds[0].revents != 0)
+					break;
+				if(count == 2U && fds[1].revents != 0)
+					answer_http();
+			}
+			if(!path_.empty())
+				write_file();
+		});
+	return true;
+}
+
+auto MetricsExporter::write_file() noexcept -> void
+{
+	auto const tmp = path_ + ".tmp";
+	{
+		std::ofstream f(tmp, std::ios_base::binary | std::ios_base::out);
+		print_metrics(f);
+		if(!f)
+		{
+			std::cerr << exe_ << ": Could not write metrics to '" << tmp
+					  << "'.\n";
+			return;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmp, path_, ec);
+	if(ec)
+		std::cerr << exe_ << ": Could not write metrics to '" << path_
+				  << "'.\n";
+}
+
+auto MetricsExporter::answer_http() noexcept -> void
+{
+	int const fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+	if(fd == -1)
+		return;
+	// NOTE: Any request gets the metrics, but wait for it to arrive (for a
+	// bit) so the client doesn't see its connection reset.
+	timeval const timeout{1, 0};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	std::string request;
+	std::array<char, 1024U> chunk{};
+	while(request.find("\r\n\r\n") == std::string::npos &&
+	      request.size() < 8192U)
+	{
+		auto const n = recv(fd, chunk.data(), chunk.size(), 0);
+		if(n <= 0)
+			break;
+		request.append(chunk.data(), static_cast<size_t>(n));
+	}
+	std::ostringstream body;
+	print_metrics(body);
+	auto const b = body.str();
+	write_all(fd, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; "
+	              "version=0.0.4\r\nContent-Length: " +
+	                  std::to_string(b.size()) + "\r\n\r\n");
+	write_all(fd, b);
+	close(fd);
+}
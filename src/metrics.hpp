@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_METRICS_HPP
+#define ERP_METRICS_HPP
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Process-wide metrics in Prometheus text format. Every thread counts into
+// its own block without locking, blocks are only summed when scraped.
+
+enum class Stage
+{
+	LOAD,    // Reading and decompressing the replay.
+	ANALYZE, // `analyze`.
+	OUTPUT,  // Everything after, until the output is ready.
+
+	COUNT
+};
+
+// Times a stage of the current replay, which is also the stage a failure of
+// the replay is blamed on until another one starts.
+class StageTimer final
+{
+public:
+	explicit StageTimer(Stage stage) noexcept;
+	StageTimer(StageTimer const&) = delete;
+	StageTimer& operator=(StageTimer const&) = delete;
+	~StageTimer() noexcept;
+
+private:
+	Stage stage_;
+	std::chrono::steady_clock::time_point start_;
+};
+
+auto metrics_replay_done(bool success, uint64_t bytes_in) noexcept -> void;
+
+auto metrics_bytes_out(uint64_t bytes) noexcept -> void;
+
+// Adds a value read from elsewhere (queue depths, cache counters...) when
+// scraped. `type` is "counter" or "gauge".
+auto metrics_add_value(std::string name, std::string help, std::string type,
+                       std::function<double()> read) noexcept -> void;
+
+// Removes the values added by `metrics_add_value` whose name starts with
+// `prefix`, before what they read from goes away.
+auto metrics_remove_values(std::string_view prefix) noexcept -> void;
+
+auto print_metrics(std::ostream& out) noexcept -> void;
+
+// Writes the metrics to `path` every few seconds and when stopped (through
+// a temporary file, so readers never see half of them) and/or answers HTTP
+// requests for them on 127.0.0.1:`port`.
+class MetricsExporter final
+{
+public:
+	MetricsExporter() noexcept = default;
+	MetricsExporter(MetricsExporter const&) = delete;
+	MetricsExporter& operator=(MetricsExporter const&) = delete;
+	~MetricsExporter() noexcept;
+
+	auto start(std::string_view exe, std::optional<std::string_view> path,
+	           std::optional<uint16_t> port) noexcept -> bool;
+
+private:
+	auto write_file() noexcept -> void;
+
+	auto answer_http() noexcept -> void;
+
+	std::string exe_;
+	std::string path_;
+	int listen_fd_{-1};
+	int stop_fd_{-1};
+	std::thread thread_;
+};
+
+#endif // ERP_METRICS_HPP
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_PARALLEL_HPP
+#define ERP_PARALLEL_HPP
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Calls `work(i)` for every `i` in [0, count) using up to `jobs` threads, and
+// hands each result to `sink(i, result)` in order from the calling thread.
+// Workers are kept at most a few results ahead of `sink` so memory use does
+// not depend on `count`.
+template<typename Work, typename Sink>
+auto parallel_ordered(size_t count, unsigned jobs, Work&& work,
+                      Sink&& sink) noexcept -> void
+{
+	using Result = std::invoke_result_t<Work&, size_t>;
+	if(jobs <= 1U || count <= 1U)
+	{
+		for(size_t i = 0U; i < count; i++)
+			sink(i, work(i));
+		return;
+	}
+	size_t const window = size_t{jobs} * 4U;
+	std::vector<std::optional<Result>> ring(window);
+	std::mutex mtx;
+	std::condition_variable produced;
+	std::condition_variable consumed;
+	size_t next_work = 0U;
+	size_t next_sink = 0U;
+	auto worker = [&]()
+	{
+		for(;;)
+		{
+			size_t i{};
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				consumed.wait(lock,
+				              [&]()
+				              {
+								  return next_work >= count ||
+								         next_work < next_sink + window;
+							  });
+				if(next_work >= count)
+					return;
+				i = next_work++;
+			}
+			auto r = work(i);
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				ring[i % window].emplace(std::move(r));
+			}
+			produced.notify_one();
+		}
+	};
+	std::vector<std::thread> threads;
+	threads.reserve(jobs);
+	for(unsigned j = 0U; j < jobs; j++)
+		threads.emplace_back(worker);
+	for(size_t i = 0U; i < count; i++)
+	{
+		std::optional<Result> r;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			produced.wait(lock,
+			              [&]() { return ring[i % window].has_value(); });
+			r.swap(ring[i % window]);
+			next_sink = i + 1U;
+		}
+		consumed.notify_all();
+		sink(i, std::move(*r));
+	}
+	for(auto& t : threads)
+		t.join();
+}
+
+#endif // ERP_PARALLEL_HPP
@@ -5,9 +5,15 @@
  */
 #include "parser.hpp"
 
+#include <algorithm> // std::sort, std::unique
+#include <cstdlib>   // std::atexit
 #include <google/protobuf/arena.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/stubs/common.h>
 #include <google/protobuf/util/json_util.h>
 #include <map>
+#include <mutex> // std::call_once
+#include <tuple> // std::tie
 #include <ygopen/client/board.hpp>
 #include <ygopen/client/card.hpp>
 #include <ygopen/client/default_card_traits.hpp>
@@ -17,11 +23,75 @@
 #include <ygopen/codec/edo9300_ocgcore_encode.hpp>
 #include <ygopen/proto/replay.hpp>
 
+#include "framing.hpp" // is_prompt
+#include "probes.hpp"
+
 namespace
 {
 
 using PBArena = google::protobuf::Arena;
 
+// NOTE: Deferred until messages are actually parsed, commands that only read
+// headers, names or decks never get here.
+auto init_protobuf() noexcept -> void
+{
+	static std::once_flag once;
+	std::call_once(once,
+	               []()
+	               {
+					   GOOGLE_PROTOBUF_VERIFY_VERSION;
+					   std::atexit(
+						   []() { google::protobuf::ShutdownProtobufLibrary(); });
+				   });
+}
+
+auto to_json(YGOpen::Proto::Replay const& replay) noexcept -> std::string
+{
+	std::string out;
+	auto options = google::protobuf::util::JsonPrintOptions{};
+	options.always_print_fields_with_no_presence = true;
+	options.always_print_enums_as_ints = true;
+	(void)google::protobuf::util::MessageToJsonString(replay, &out, options);
+	return out;
+}
+
+// Appends the value of every non-zero uint32 field named "code" in `msg` and
+// its submessages, or of the "value" inside one if it is a wrapper message.
+auto collect_codes(google::protobuf::Message const& msg,
+                   std::vector<uint32_t>& codes,
+                   bool in_code = false) noexcept -> void
+{
+	using google::protobuf::FieldDescriptor;
+	auto const* reflection = msg.GetReflection();
+	std::vector<FieldDescriptor const*> fields;
+	reflection->ListFields(msg, &fields);
+	for(auto const* field : fields)
+	{
+		bool const is_code = field->name() == (in_code ? "value" : "code");
+		if(field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+		{
+			if(!field->is_repeated())
+			{
+				collect_codes(reflection->GetMessage(msg, field), codes, is_code);
+				continue;
+			}
+			for(int i = 0; i < reflection->FieldSize(msg, field); i++)
+				collect_codes(reflection->GetRepeatedMessage(msg, field, i),
+				              codes, is_code);
+			continue;
+		}
+		if(!is_code || field->cpp_type() != FieldDescriptor::CPPTYPE_UINT32)
+			continue;
+		if(!field->is_repeated())
+		{
+			codes.push_back(reflection->GetUInt32(msg, field));
+			continue;
+		}
+		for(int i = 0; i < reflection->FieldSize(msg, field); i++)
+			codes.push_back(reflection->GetRepeatedUInt32(msg, field, i));
+	}
+}
+
 class ReplayContext final : public YGOpen::Codec::IEncodeContext
 {
 public:
@@ -78,7 +148,62 @@ public:
 
 	auto arena() noexcept -> google::protobuf::Arena& { return arena_; }
 
-	auto parse(YGOpen::Proto::Duel::Msg& msg) noexcept -> void
+	auto chain_size() const noexcept -> uint32_t
+	{
+		return static_cast<uint32_t>(board_.chain_stack().size());
+	}
+
+	auto turn_and_phase() const noexcept -> std::pair<uint32_t, uint32_t>
+	{
+		return {static_cast<uint32_t>(board_.turn()),
+		        static_cast<uint32_t>(board_.phase())};
+	}
+
+	auto board_stats() const noexcept -> BoardStats
+	{
+		using namespace YGOpen::Duel;
+		BoardStats s{};
+		std::tie(s.turn, s.phase) = turn_and_phase();
+		s.turn_controller = static_cast<uint32_t>(board_.turn_controller());
+		s.chain_size = chain_size();
+		auto const& frame = board_.frame();
+		auto pile_size = [&](Con con, Loc loc) -> uint32_t
+		{
+			return static_cast<uint32_t>(frame.pile(con, loc).size());
+		};
+		auto zones_mask = [&](Con con, Loc loc, uint32_t count) -> uint32_t
+		{
+			uint32_t mask = 0U;
+			Place p;
+			p.set_con(con);
+			p.set_loc(loc);
+			for(uint32_t seq = 0U; seq < count; seq++)
+			{
+				p.set_seq(seq);
+				if(frame.has_card(p))
+					mask |= 1U << seq;
+			}
+			return mask;
+		};
+		for(auto const con : {CONTROLLER_0, CONTROLLER_1})
+		{
+			auto const i = static_cast<size_t>(con);
+			s.lp[i] = static_cast<uint32_t>(board_.lp(con));
+			s.main_deck[i] = pile_size(con, LOCATION_MAIN_DECK);
+			s.hand[i] = pile_size(con, LOCATION_HAND);
+			s.extra_deck[i] = pile_size(con, LOCATION_EXTRA_DECK);
+			s.graveyard[i] = pile_size(con, LOCATION_GRAVEYARD);
+			s.banished[i] = pile_size(con, LOCATION_BANISHED);
+			s.monster_zones[i] = zones_mask(con, LOCATION_MONSTER_ZONE, 7U);
+			s.spell_zones[i] = zones_mask(con, LOCATION_SPELL_ZONE, 8U);
+		}
+		return s;
+	}
+
+	// Returns whether the message only carries queries that change nothing,
+	// either because they point to no card or because every one of their
+	// fields was already cached.
+	auto parse(YGOpen::Proto::Duel::Msg& msg) noexcept -> bool
 	{
 		// Append message to the stream.
 		{
@@ -90,18 +215,20 @@ public:
 			parse_event(board_, msg.event());
 		using namespace YGOpen::Client;
 		auto& queries = *msg.mutable_queries();
-		auto it = queries.begin();
-		while(it != queries.end())
+		bool redundant = msg.t_case() == YGOpen::Proto::Duel::Msg::T_NOT_SET &&
+		                 !queries.empty();
+		// NOTE: Queries are compacted in place and the leftovers dropped at
+		// once, erasing them one by one is quadratic on hostile replays.
+		int kept = 0;
+		for(int i = 0; i < queries.size(); i++)
 		{
+			auto& query = queries[i];
 			// Remove queries that do not point to a card.
 			// Needed for old replays.
-			if(!board_.frame().has_card(it->place()))
-			{
-				it = queries.erase(it);
+			if(!board_.frame().has_card(query.place()))
 				continue;
-			}
-			auto const hits = parse_query<true>(board_.frame(), *it);
-			auto* data = it->mutable_data();
+			auto const hits = parse_query<true>(board_.frame(), query);
+			auto* data = query.mutable_data();
 			using namespace YGOpen::Client;
 #define X(NAME, Name, name, value)       \
 	if(!!(hits & (QueryCacheHit::NAME))) \
@@ -112,19 +239,33 @@ public:
 #undef EXPAND_SEPARATE_LINK_DATA_QUERIES
 #undef EXPAND_ARRAY_LIKE_QUERIES
 #undef X
-			++it;
+			redundant = redundant && data->ByteSizeLong() == 0U;
+			if(i != kept)
+				queries.SwapElements(i, kept);
+			kept++;
 		}
+		queries.DeleteSubrange(kept, queries.size() - kept);
+		return redundant;
 	}
 
 	auto serialize() noexcept -> std::string
 	{
-		std::string out;
-		auto options = google::protobuf::util::JsonPrintOptions{};
-		options.always_print_fields_with_no_presence = true;
-		options.always_print_enums_as_ints = true;
-		(void)google::protobuf::util::MessageToJsonString(replay_, &out,
-		                                                  options);
-		return out;
+		ERP_PROBE1(serialize__start, 0);
+		auto json = to_json(replay_);
+		ERP_PROBE1(serialize__done, json.size());
+		return json;
+	}
+
+	// Binary protobuf of each block of the stream.
+	auto serialize_blocks() const noexcept -> std::vector<std::string>
+	{
+		ERP_PROBE1(serialize__start, 1);
+		std::vector<std::string> blocks;
+		blocks.reserve(replay_.stream().blocks_size());
+		for(auto const& block : replay_.stream().blocks())
+			blocks.emplace_back(block.SerializeAsString());
+		ERP_PROBE1(serialize__done, blocks.size());
+		return blocks;
 	}
 
 private:
@@ -156,19 +297,40 @@ private:
 
 } // namespace
 
-auto analyze(std::string_view exe, uint8_t* buffer,
-             size_t size) noexcept -> AnalyzeResult
+auto analyze(std::string_view exe, uint8_t* buffer, size_t size,
+             AnalyzeOptions const& options) noexcept -> AnalyzeResult
 {
+	init_protobuf();
 	decltype(buffer) const sentry = buffer + size;
 	uint8_t* orm_buffer = nullptr;
 	size_t orm_size = 0;
+	uint32_t msg_index = 0U;
+	std::vector<Decision> decisions;
+	PromptIndex prompts;
+	Timeline timeline;
+	std::pair<uint32_t, uint32_t> last_turn_and_phase{};
+	uint32_t last_chain_size = 0U;
+	uint32_t chain_links = 0U;
+	CardTracker tracker;
+	MessageColumns columns;
+	std::vector<uint32_t> redundant_frames;
+	std::vector<uint32_t> codes;
 	ReplayContext ctx;
+	size_t frames = 0U;
+	if(options.record_timeline)
+		timeline.append(0U, ctx.board_stats(), 0U); // Starting state.
 	do
 	{
+		if(options.frame_limit != 0U && frames == options.frame_limit)
+			break;
+		if(options.checkpoint && frames != 0U &&
+		   frames % AnalyzeOptions::CHECKPOINT_FRAMES == 0U)
+			options.checkpoint();
+		frames++;
 		if(sentry < buffer + sizeof(uint8_t) + sizeof(uint32_t))
 		{
 			std::cerr << exe << ": Unexpectedly short size for next message.\n";
-			return {false, {}, {}, {}};
+			return {};
 		}
 		// NOTE: Replays have size and msg_type swapped for some reason, we do
 		// that swap here before trying to encode.
@@ -183,21 +345,71 @@ auto analyze(std::string_view exe, uint8_t* buffer,
 			// NOTE: Don't eat the type as `encode_one` needs it.
 			return {msg, size};
 		}();
+		// NOTE: `buffer` now points at the type, the payload follows it.
+		if(msg_size > static_cast<size_t>(sentry - buffer) - 1U)
+		{
+			std::cerr << exe << ": Message size exceeds replay size.\n";
+			return {};
+		}
 		if(msg_type == 231U) // NOLINT: OLD_REPLAY_FORMAT
 		{
 			orm_buffer = buffer + 1U; // Eat msg_type to align with header.
 			orm_size = msg_size;
 			break;
 		}
+		if(options.record_prompts && is_prompt(msg_type))
+		{
+			prompts.msg_index.push_back(msg_index);
+			prompts.msg_type.push_back(msg_type);
+		}
+		if(options.record_trajectories)
+			tracker.track(msg_index, ctx.turn_and_phase().first, msg_type,
+			              buffer + 1U, msg_size);
 		// Actual encoding.
 		using namespace YGOpen::Codec;
+		auto const* const msg_data = buffer + 1U;
+		ERP_PROBE3(analyze__message, msg_index, msg_type, msg_size);
 		auto r = Edo9300::OCGCore::encode_one(ctx.arena(), ctx, buffer);
+		ERP_PROBE2(analyze__encode, msg_index, static_cast<int>(r.state));
 		buffer += r.bytes_read;
+		// NOTE: Prompts are the same as in `PromptIndex`, so the n-th decision
+		// is the one that consumes the n-th response. A request changes
+		// nothing on the board, so it is sampled before being parsed.
+		if(options.record_decisions && is_prompt(msg_type))
+		{
+			uint32_t type = 0U;
+			if(r.state == EncodeOneResult::State::OK &&
+			   r.msg->t_case() == YGOpen::Proto::Duel::Msg::kRequest)
+				type = static_cast<uint32_t>(r.msg->request().t_case());
+			decisions.push_back({msg_index, type, ctx.board_stats()});
+		}
 		switch(r.state)
 		{
 		case EncodeOneResult::State::OK:
 		{
-			ctx.parse(*r.msg);
+			if(ctx.parse(*r.msg) && options.record_redundant)
+				redundant_frames.push_back(static_cast<uint32_t>(frames - 1U));
+			if(options.record_columns)
+				columns.append(msg_index, ctx.turn_and_phase().first, msg_type,
+				               msg_data, msg_size);
+			// NOTE: After `parse`, so queries for missing cards are gone.
+			if(options.record_codes)
+				collect_codes(*r.msg, codes);
+			if(options.record_timeline)
+			{
+				auto const chain_size = ctx.chain_size();
+				if(chain_size > last_chain_size)
+					chain_links += chain_size - last_chain_size;
+				last_chain_size = chain_size;
+				if(auto const tp = ctx.turn_and_phase();
+				   tp != last_turn_and_phase)
+				{
+					timeline.append(msg_index, ctx.board_stats(), chain_links);
+					last_turn_and_phase = tp;
+					chain_links = 0U;
+				}
+			}
+			msg_index++;
 			break;
 		}
 		case EncodeOneResult::State::SWALLOWED:
@@ -208,13 +420,40 @@ auto analyze(std::string_view exe, uint8_t* buffer,
 		default: // EncodeOneResult::State::UNKNOWN
 			std::cerr << exe << ": Encountered unknown core message number: ";
 			std::cerr << static_cast<int>(msg_type) << ".\n";
-			return {false, {}, {}, {}};
+			return {};
 		}
 		if((msg_size + 1U) != r.bytes_read)
 		{
 			std::cerr << exe << ": Read length for message is mismatched.\n";
-			return {false, {}, {}, {}};
+			return {};
 		}
 	} while(sentry != buffer);
-	return {true, ctx.serialize(), orm_buffer, orm_size};
+	// NOTE: The outcome, which the last turn or phase change doesn't show.
+	if(options.record_timeline)
+		timeline.append(msg_index, ctx.board_stats(), chain_links);
+	std::sort(codes.begin(), codes.end());
+	codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+	if(!codes.empty() && codes.front() == 0U)
+		codes.erase(codes.begin()); // NOTE: Hidden cards.
+	return {true,
+	        options.serialize_messages ? ctx.serialize() : std::string{},
+	        options.serialize_blocks ? ctx.serialize_blocks()
+	                                 : std::vector<std::string>{},
+	        std::move(decisions), std::move(prompts), std::move(timeline),
+	        tracker.take_trajectories(), std::move(columns),
+	        std::move(redundant_frames), std::move(codes), msg_index,
+	        ctx.board_stats(), orm_buffer, orm_size};
+}
+
+auto blocks_to_json(std::vector<std::string> const& blocks) noexcept
+	-> std::optional<std::string>
+{
+	init_protobuf();
+	PBArena arena;
+	auto& replay = *PBArena::Create<YGOpen::Proto::Replay>(&arena);
+	auto& stream = *replay.mutable_stream();
+	for(auto const& block : blocks)
+		if(!stream.add_blocks()->ParseFromString(block))
+			return std::nullopt;
+	return to_json(replay);
 }
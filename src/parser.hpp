@@ -6,18 +6,79 @@
 #ifndef ERP_PARSER_HPP
 #define ERP_PARSER_HPP
 #include <cstdint>
+#include <functional>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
+
+#include "board_stats.hpp"
+#include "message_columns.hpp"
+#include "timeline.hpp"
+#include "trajectory.hpp"
+
+struct AnalyzeOptions
+{
+	bool serialize_messages;  // Fills `AnalyzeResult::duel_messages`.
+	bool serialize_blocks;    // Fills `AnalyzeResult::message_blocks`.
+	bool record_decisions;    // Fills `AnalyzeResult::decisions`.
+	bool record_prompts;      // Fills `AnalyzeResult::prompts`.
+	bool record_timeline;     // Fills `AnalyzeResult::timeline`.
+	bool record_trajectories; // Fills `AnalyzeResult::trajectories`.
+	bool record_columns;      // Fills `AnalyzeResult::columns`.
+	bool record_redundant;    // Fills `AnalyzeResult::redundant_frames`.
+	bool record_codes;        // Fills `AnalyzeResult::codes`.
+	size_t frame_limit;       // Stop after this many messages, 0 for all.
+	// Called every `CHECKPOINT_FRAMES` messages, so a scheduler can pause
+	// the analysis there. Optional.
+	std::function<void()> checkpoint;
+
+	static constexpr size_t CHECKPOINT_FRAMES = 256U;
+};
+
+// A message that requests a response from a duelist, as told by `is_prompt`.
+struct Decision
+{
+	uint32_t msg_index;
+	uint32_t request_type; // Msg.Request oneof case, 0 if not encoded as one.
+	BoardStats board;
+};
+
+// Messages that consume a response, in order. `msg_index` is the index of
+// the message in the stream, `msg_type` its core message number.
+struct PromptIndex
+{
+	std::vector<uint32_t> msg_index;
+	std::vector<uint8_t> msg_type;
+};
 
 struct AnalyzeResult
 {
 	bool success;
 	std::string duel_messages;
+	std::vector<std::string> message_blocks; // Binary, one per stream block.
+	std::vector<Decision> decisions;
+	PromptIndex prompts;
+	Timeline timeline;
+	std::vector<Trajectory> trajectories;
+	MessageColumns columns;
+	// Core messages (counting every one in the stream, not only the ones
+	// that are encoded) whose queries change nothing and could be dropped.
+	std::vector<uint32_t> redundant_frames;
+	// Every card code found in the encoded messages, sorted and unique.
+	std::vector<uint32_t> codes;
+	uint32_t message_count; // Encoded messages.
+	BoardStats board; // After the last analyzed message.
 	uint8_t* old_replay_mode_buffer;
 	size_t old_replay_mode_size;
 };
 
-auto analyze(std::string_view exe, uint8_t* buffer,
-             size_t size) noexcept -> AnalyzeResult;
+auto analyze(std::string_view exe, uint8_t* buffer, size_t size,
+             AnalyzeOptions const& options) noexcept -> AnalyzeResult;
+
+// Converts blocks as in `AnalyzeResult::message_blocks` back into the JSON of
+// `AnalyzeResult::duel_messages`, or nullopt if a block is corrupted.
+auto blocks_to_json(std::vector<std::string> const& blocks) noexcept
+	-> std::optional<std::string>;
 
 #endif // ERP_PARSER_HPP
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+// Stands in for parser.cpp in erp-lite, which is built without protobuf and
+// ygopen so it starts faster. Everything that reads headers, names, decks,
+// the duel seed, options or responses works the same, the rest fails.
+#include "parser.hpp"
+
+#include <iostream>
+
+auto analyze(std::string_view exe, uint8_t* /*buffer*/, size_t /*size*/,
+             AnalyzeOptions const& /*options*/) noexcept -> AnalyzeResult
+{
+	std::cerr << exe << ": Messages can't be parsed by erp-lite, use erp.\n";
+	return {};
+}
+
+auto blocks_to_json(std::vector<std::string> const& /*blocks*/) noexcept
+	-> std::optional<std::string>
+{
+	std::cerr << "Messages can't be decoded by erp-lite, use erp.\n";
+	return std::nullopt;
+}
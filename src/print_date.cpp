@@ -7,10 +7,17 @@
 
 #include <ctime>
 #include <iomanip>
-#include <iostream>
+#include <ostream>
 
-auto print_date(uint32_t timestamp) noexcept -> void
+auto print_date(std::ostream& out, uint32_t timestamp) noexcept -> void
 {
 	auto const t = std::time_t{timestamp};
-	std::cout << std::put_time(std::localtime(&t), "Date: %Y-%m-%d %H:%M:%S\n");
+	std::tm tm{};
+	// NOTE: `std::localtime` is not thread-safe.
+#ifdef _WIN32
+	localtime_s(&tm, &t);
+#else
+	localtime_r(&t, &tm);
+#endif // _WIN32
+	out << std::put_time(&tm, "Date: %Y-%m-%d %H:%M:%S\n");
 }
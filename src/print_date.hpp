@@ -6,7 +6,8 @@
 #ifndef ERP_PRINT_DATE_HPP
 #define ERP_PRINT_DATE_HPP
 #include <cstdint>
+#include <iosfwd>
 
-auto print_date(uint32_t timestamp) noexcept -> void;
+auto print_date(std::ostream& out, uint32_t timestamp) noexcept -> void;
 
 #endif // ERP_PRINT_DATE_HPP
@@ -7,8 +7,8 @@
 
 #include <codecvt>
 #include <cstring> // std::memcpy
-#include <iostream>
 #include <locale>
+#include <ostream>
 
 #include "replay_data.hpp" // REPLAY_SINGLE_MODE
 
@@ -27,7 +27,8 @@ std::u16string buffer_to_utf16(const void* data,
 		return str;
 	const auto* p = reinterpret_cast<const uint8_t*>(data);
 	str.reserve((max_byte_count / 2U) + 1U);
-	for(const auto* tg = p + max_byte_count; p <= tg; p += sizeof(char16_t))
+	for(const auto* tg = p + max_byte_count; p + sizeof(char16_t) <= tg;
+	    p += sizeof(char16_t))
 	{
 		char16_t to_append{};
 		std::memcpy(&to_append, p, sizeof(to_append));
@@ -64,31 +65,59 @@ constexpr auto VS_STR = " vs. ";
 
 } // namespace
 
-auto print_names(uint32_t flags, uint8_t const* ptr) noexcept -> void
+auto read_names(uint32_t flags, uint8_t const* ptr, size_t size) noexcept
+	-> std::optional<DuelistNames>
 {
-	auto print_one = [&]()
+	auto const* const sentry = ptr + size;
+	auto left = [&]() noexcept
 	{
-		std::cout << utf16_to_utf8(buffer_to_utf16(ptr, 40U));
+		return static_cast<uint64_t>(sentry - ptr);
+	};
+	DuelistNames r{};
+	auto read_one = [&]()
+	{
+		r.names.emplace_back(utf16_to_utf8(buffer_to_utf16(ptr, 40U)));
 		ptr += 40U;
 	};
 	if((flags & REPLAY_SINGLE_MODE) != 0U)
 	{
-		print_one();
-		std::cout << VS_STR;
-		print_one();
-		std::cout << '\n';
-		return;
+		if(left() < 40U * 2U)
+			return std::nullopt;
+		read_one();
+		read_one();
+		r.team1_count = 1U;
+		return r;
 	}
 	for(int i = 2; i != 0; --i)
 	{
-		for(uint32_t j = read<uint32_t>(ptr); j != 0; --j)
-		{
-			print_one();
-			if(j != 1)
-				std::cout << SEP_STR;
-		}
+		if(left() < sizeof(uint32_t))
+			return std::nullopt;
+		auto const count = read<uint32_t>(ptr);
+		if(left() < 40U * uint64_t{count})
+			return std::nullopt;
+		for(uint32_t j = count; j != 0; --j)
+			read_one();
 		if(i == 2)
-			std::cout << VS_STR;
+			r.team1_count = r.names.size();
+	}
+	return r;
+}
+
+auto print_names(std::ostream& out, uint32_t flags, uint8_t const* ptr,
+                 size_t size) noexcept -> bool
+{
+	auto const r = read_names(flags, ptr, size);
+	if(!r.has_value())
+		return false;
+	auto const& [names, team1_count] = *r;
+	for(size_t i = 0U; i < names.size(); i++)
+	{
+		if(i == team1_count)
+			out << VS_STR;
+		else if(i != 0U)
+			out << SEP_STR;
+		out << names[i];
 	}
-	std::cout << '\n';
+	out << '\n';
+	return true;
 }
@@ -6,7 +6,23 @@
 #ifndef ERP_PRINT_NAMES_HPP
 #define ERP_PRINT_NAMES_HPP
 #include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <vector>
 
-auto print_names(uint32_t flags, uint8_t const* ptr) noexcept -> void;
+struct DuelistNames
+{
+	std::vector<std::string> names; // UTF-8, team 1 first.
+	size_t team1_count;
+};
+
+// Both fail if the replay is truncated before the end of the names, which
+// take at most `size` bytes from `ptr`.
+auto read_names(uint32_t flags, uint8_t const* ptr, size_t size) noexcept
+	-> std::optional<DuelistNames>;
+
+auto print_names(std::ostream& out, uint32_t flags, uint8_t const* ptr,
+                 size_t size) noexcept -> bool;
 
 #endif // ERP_PRINT_NAMES_HPP
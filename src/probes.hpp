@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_PROBES_HPP
+#define ERP_PROBES_HPP
+
+// USDT probes of provider "erp", for bpftrace/perf to attach to a running
+// process (e.g. `bpftrace -l 'usdt:./erp:erp:*'`). Built in with the meson
+// option usdt; each is then a single nop until something attaches to it,
+// and without it they don't exist at all. Probes and their arguments:
+//   replay__start   (char const* fn, size_t fn_size)  fn isn't NUL-ended.
+//   replay__done    (int success)
+//   stage__start    (int stage)                  See `Stage`.
+//   stage__done     (int stage, int64_t ns)
+//   decompress__start (size_t compressed_size, size_t expected_size)
+//   decompress__done  (size_t decompressed_size) 0 on failure.
+//   analyze__message  (uint32_t msg_index, uint8_t msg_type,
+//                      uint32_t msg_size)
+//   analyze__encode   (uint32_t msg_index, int state) EncodeOneResult::State
+//   serialize__start  (int blocks)               0 for JSON, 1 for blocks.
+//   serialize__done   (size_t size)              Bytes, or blocks.
+#ifdef ERP_HAVE_USDT
+#include <sys/sdt.h>
+#define ERP_PROBE1(name, a) DTRACE_PROBE1(erp, name, a)
+#define ERP_PROBE2(name, a, b) DTRACE_PROBE2(erp, name, a, b)
+#define ERP_PROBE3(name, a, b, c) DTRACE_PROBE3(erp, name, a, b, c)
+#else
+#define ERP_PROBE1(name, a) \
+	do                      \
+	{                       \
+	} while(0)
+#define ERP_PROBE2(name, a, b) ERP_PROBE1(name, a)
+#define ERP_PROBE3(name, a, b, c) ERP_PROBE1(name, a)
+#endif // ERP_HAVE_USDT
+
+#endif // ERP_PROBES_HPP
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "recompress.hpp"
+
+#include <cstdlib> // std::free
+#include <cstring> // std::memcpy
+#include <fstream>
+#include <iostream>
+#include <lzma.h>
+#include <string>
+
+namespace
+{
+
+constexpr size_t PROPS_SIZE = 5U;
+
+} // namespace
+
+auto compress_body(std::string_view exe, ExtendedReplayHeader& header,
+                   uint8_t const* data, size_t size,
+                   std::optional<uint32_t> preset) noexcept
+	-> std::vector<uint8_t>
+{
+	auto fail = [&](std::string_view e) -> std::vector<uint8_t>
+	{
+		std::cerr << exe << ": Error compressing replay: " << e << ".\n";
+		return {};
+	};
+	lzma_options_lzma opts{};
+	if(preset.has_value())
+	{
+		if(lzma_lzma_preset(&opts, *preset))
+			return fail("Unsupported preset");
+		// NOTE: A dictionary bigger than the contents only costs memory to
+		// whoever decompresses the replay.
+		auto dict_size = uint32_t{LZMA_DICT_SIZE_MIN};
+		while(dict_size < size && dict_size < opts.dict_size)
+			dict_size <<= 1U;
+		opts.dict_size = dict_size;
+	}
+	else
+	{
+		lzma_filter filter{LZMA_FILTER_LZMA1, nullptr};
+		if(lzma_properties_decode(&filter, nullptr, header.base.props,
+		                          PROPS_SIZE) != LZMA_OK)
+			return fail("Invalid props");
+		// NOTE: Props only hold these, the encoder needs the rest too.
+		lzma_options_lzma props{};
+		std::memcpy(&props, filter.options, sizeof(props));
+		std::free(filter.options);
+		lzma_lzma_preset(&opts, LZMA_PRESET_DEFAULT);
+		opts.dict_size = props.dict_size;
+		opts.lc = props.lc;
+		opts.lp = props.lp;
+		opts.pb = props.pb;
+	}
+	lzma_filter filters[] = {{LZMA_FILTER_LZMA1, &opts},
+	                         {LZMA_VLI_UNKNOWN, nullptr}};
+	std::vector<uint8_t> out(lzma_stream_buffer_bound(size));
+	size_t out_pos = 0U;
+	// NOTE: The raw encoder ends the stream with an end marker, which is
+	// fine as the decompressed size is also stored in the header.
+	if(lzma_raw_buffer_encode(filters, nullptr, data, size, out.data(),
+	                          &out_pos, out.size()) != LZMA_OK)
+		return fail("Stream encoding failed");
+	out.resize(out_pos);
+	if(preset.has_value() &&
+	   lzma_properties_encode(filters, header.base.props) != LZMA_OK)
+		return fail("Could not encode props");
+	header.base.size = static_cast<uint32_t>(size);
+	return out;
+}
+
+auto serialize_replay(ExtendedReplayHeader const& header,
+                      std::vector<uint8_t> const& body) noexcept
+	-> std::vector<uint8_t>
+{
+	auto const header_size = (header.base.flags & REPLAY_EXTENDED_HEADER) != 0
+	                             ? sizeof(ExtendedReplayHeader)
+	                             : sizeof(ReplayHeader);
+	std::vector<uint8_t> out(header_size + body.size());
+	std::memcpy(out.data(), &header, header_size);
+	std::memcpy(out.data() + header_size, body.data(), body.size());
+	return out;
+}
+
+auto replace_old_replay(std::vector<uint8_t> const& buffer,
+                        uint8_t const* orm_buffer, size_t orm_size,
+                        std::vector<uint8_t> const& orm) noexcept
+	-> std::vector<uint8_t>
+{
+	// NOTE: Type and size of the message come right before its contents.
+	auto const* const frame = orm_buffer - sizeof(uint8_t) - sizeof(uint32_t);
+	auto const* const frame_end = orm_buffer + orm_size;
+	std::vector<uint8_t> out(buffer.data(), frame);
+	out.push_back(*frame);
+	auto const size = static_cast<uint32_t>(orm.size());
+	for(unsigned i = 0U; i < sizeof(size); i++)
+		out.push_back(static_cast<uint8_t>((size >> (8U * i)) & 0xFFU));
+	out.insert(out.end(), orm.begin(), orm.end());
+	out.insert(out.end(), frame_end, buffer.data() + buffer.size());
+	return out;
+}
+
+auto write_file(std::string_view exe, std::string_view path,
+                std::vector<uint8_t> const& data) noexcept -> bool
+{
+	std::ofstream f(std::string{path},
+	                std::ios_base::binary | std::ios_base::out);
+	f.write(reinterpret_cast<char const*>(data.data()), data.size());
+	if(!f)
+	{
+		std::cerr << exe << ": Could not write file '" << path << "'.\n";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_RECOMPRESS_HPP
+#define ERP_RECOMPRESS_HPP
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "replay_data.hpp"
+
+// Compresses the contents of a replay with LZMA1, as read by `decompress`.
+// The props of `header` are kept unless a liblzma `preset` is given, in
+// which case they are replaced by the ones of the preset. The size of
+// `header` is updated. Returns empty on error.
+auto compress_body(std::string_view exe, ExtendedReplayHeader& header,
+                   uint8_t const* data, size_t size,
+                   std::optional<uint32_t> preset) noexcept
+	-> std::vector<uint8_t>;
+
+// The header (short or extended, as its flags say) followed by `body`.
+auto serialize_replay(ExtendedReplayHeader const& header,
+                      std::vector<uint8_t> const& body) noexcept
+	-> std::vector<uint8_t>;
+
+// The contents of a yrpX with its OLD_REPLAY_MODE message, whose contents
+// are at `orm_buffer` as returned by `find_old_replay_mode`, replaced by
+// `orm`.
+auto replace_old_replay(std::vector<uint8_t> const& buffer,
+                        uint8_t const* orm_buffer, size_t orm_size,
+                        std::vector<uint8_t> const& orm) noexcept
+	-> std::vector<uint8_t>;
+
+auto write_file(std::string_view exe, std::string_view path,
+                std::vector<uint8_t> const& data) noexcept -> bool;
+
+#endif // ERP_RECOMPRESS_HPP
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "replay_file.hpp"
+
+#include <array>
+#include <cstring> // std::memcpy
+#include <fstream>
+#include <iostream>
+#include <limits> // std::numeric_limits
+#include <string>
+
+#include "decompress.hpp"
+
+namespace
+{
+
+#include "read.inl"
+
+constexpr auto IOS_IN = std::ios_base::binary | std::ios_base::in;
+
+// Whether `n` more bytes can be read from `ptr` before reaching `sentry`.
+auto fits(uint8_t const* ptr, uint8_t const* sentry, uint64_t n) noexcept
+	-> bool
+{
+	return ptr <= sentry && n <= static_cast<uint64_t>(sentry - ptr);
+}
+
+auto read_replay_contents(std::string_view exe,
+                          ExtendedReplayHeader const& header, std::istream& f,
+                          size_t filesize) noexcept -> std::vector<uint8_t>
+{
+	auto header_size = (header.base.flags & REPLAY_EXTENDED_HEADER) != 0
+	                       ? sizeof(ExtendedReplayHeader)
+	                       : sizeof(ReplayHeader);
+	f.seekg(0, std::ios_base::beg);
+	f.ignore(header_size);
+	const auto filesize_without_header = filesize - header_size;
+	std::vector<uint8_t> pth_buf(filesize);
+	f.read(reinterpret_cast<char*>(pth_buf.data()), filesize_without_header);
+	if(static_cast<size_t>(f.gcount()) != filesize_without_header)
+	{
+		std::cerr << exe << ": Read error\n";
+		return {};
+	}
+	if(header.base.flags & REPLAY_COMPRESSED)
+	{
+		pth_buf = decompress(exe, header, pth_buf.data(), pth_buf.size(),
+		                     header.base.size);
+		if(pth_buf.size() == 0U)
+			return {}; // NOTE: Error printed by `decompress`.
+	}
+	else if(header.base.size != filesize)
+	{
+		std::cerr << exe << ": File size doesn't match header\n";
+		return {};
+	}
+	return pth_buf;
+}
+
+} // namespace
+
+auto read_header(std::string_view exe, uint8_t const* buffer_data,
+                 ReplayTypes magic) noexcept -> ReadHeaderResult
+{
+	ReadHeaderResult r{};
+	auto& h = r.header;
+	std::memcpy(&h.base, buffer_data, sizeof(ReplayHeader));
+	if(h.base.type != magic)
+	{
+		std::cerr << exe << ": Not a yrp or yrpX file.\n";
+		return r;
+	}
+	if(h.base.flags & REPLAY_EXTENDED_HEADER)
+	{
+		std::memcpy(&h, buffer_data, sizeof(ExtendedReplayHeader));
+		if(h.header_version > ExtendedReplayHeader::latest_header_version)
+		{
+			std::cerr << exe << ": Replay version is too new.\n";
+			return r;
+		}
+	}
+	r.success = true;
+	return r;
+}
+
+auto load_replay(std::string_view exe,
+                 std::string_view fn) noexcept -> LoadReplayResult
+{
+	std::fstream f(std::string{fn}, IOS_IN);
+	if(!f.is_open())
+	{
+		std::cerr << exe << ": Could not open file '" << fn << "'.\n";
+		return {};
+	}
+	return load_replay(exe, f);
+}
+
+auto load_replay(std::string_view exe,
+                 std::istream& f) noexcept -> LoadReplayResult
+{
+	LoadReplayResult r{};
+	f.ignore(std::numeric_limits<std::streamsize>::max());
+	const auto filesize = static_cast<size_t>(f.gcount());
+	r.file_size = filesize;
+	if(filesize < sizeof(ExtendedReplayHeader))
+	{
+		std::cerr << exe << ": File too small.\n";
+		return r;
+	}
+	f.clear();
+	auto [read_yrpx_success, yrpx_header] = [&]() -> ReadHeaderResult
+	{
+		std::array<uint8_t, sizeof(ExtendedReplayHeader)> header_buffer{};
+		f.seekg(0, std::ios_base::beg);
+		f.read(reinterpret_cast<char*>(header_buffer.data()),
+		       sizeof(ExtendedReplayHeader));
+		return read_header(exe, header_buffer.data(), REPLAY_YRPX);
+	}();
+	if(!read_yrpx_success)
+		return r; // NOTE: Error printed by `read_header`.
+	if((yrpx_header.base.flags & REPLAY_HAND_TEST) != 0)
+	{
+		std::cerr << exe << ": Replay is from hand test mode\n";
+		return r;
+	}
+	auto pth_buf = read_replay_contents(exe, yrpx_header, f, filesize);
+	if(pth_buf.empty())
+		return r;
+	r.header = yrpx_header;
+	r.buffer = std::move(pth_buf);
+	r.success = true;
+	return r;
+}
+
+auto skip_duelists(uint32_t flags, uint8_t*& ptr,
+                   uint8_t const* sentry) noexcept
+	-> std::optional<unsigned>
+{
+	if((flags & REPLAY_SINGLE_MODE) != 0U)
+	{
+		if(!fits(ptr, sentry, 40U * 2U))
+			return std::nullopt;
+		ptr += 40U * 2U;
+		return 2U;
+	}
+	unsigned num_duelists = 0;
+	for(int i = 2; i != 0; --i) // Duelists of team 1, then team 2.
+	{
+		if(!fits(ptr, sentry, sizeof(uint32_t)))
+			return std::nullopt;
+		auto const count = read<uint32_t>(ptr);
+		if(!fits(ptr, sentry, 40U * uint64_t{count}))
+			return std::nullopt;
+		ptr += 40U * size_t{count};
+		num_duelists += count;
+	}
+	return num_duelists;
+}
+
+auto read_duel_flags(uint32_t flags, uint8_t*& ptr,
+                     uint8_t const* sentry) noexcept
+	-> std::optional<uint64_t>
+{
+	if((flags & REPLAY_64BIT_DUELFLAG) != 0U)
+	{
+		if(!fits(ptr, sentry, sizeof(uint64_t)))
+			return std::nullopt;
+		return read<uint64_t>(ptr);
+	}
+	if(!fits(ptr, sentry, sizeof(uint32_t)))
+		return std::nullopt;
+	return static_cast<uint64_t>(read<uint32_t>(ptr));
+}
+
+auto read_until_decks(uint32_t flags, uint8_t*& ptr,
+                      uint8_t const* sentry) noexcept
+	-> std::optional<unsigned>
+{
+	auto const num_duelists = skip_duelists(flags, ptr, sentry);
+	if(!num_duelists || !fits(ptr, sentry, sizeof(uint32_t) * 3U))
+		return std::nullopt;
+	ptr += sizeof(uint32_t) * 3U; // starting_lp, etc...
+	if(!read_duel_flags(flags, ptr, sentry))
+		return std::nullopt;
+	return num_duelists;
+}
+
+auto load_old_replay(std::string_view exe, uint8_t* buffer,
+                     size_t size) noexcept -> LoadOldReplayResult
+{
+	LoadOldReplayResult r{};
+	if(size < sizeof(ExtendedReplayHeader))
+	{
+		std::cerr << exe << ": Yrp buffer too small.\n";
+		return r;
+	}
+	auto [read_yrp_success, header] = read_header(exe, buffer, REPLAY_YRP1);
+	if(!read_yrp_success)
+		return r; // NOTE: Error printed by `read_header`.
+	auto header_size = (header.base.flags & REPLAY_EXTENDED_HEADER) != 0
+	                       ? sizeof(ExtendedReplayHeader)
+	                       : sizeof(ReplayHeader);
+	buffer += header_size;
+	size -= header_size;
+	if((header.base.flags & REPLAY_COMPRESSED) != 0)
+	{
+		r.decompressed =
+			decompress(exe, header, buffer, size, header.base.size);
+		if(r.decompressed.empty())
+			return r; // NOTE: Error printed by `decompress`.
+		buffer = r.decompressed.data();
+		size = r.decompressed.size();
+	}
+	else if(size != header.base.size)
+	{
+		std::cerr << exe << ": Yrp buffer size doesn't match header\n";
+		return r;
+	}
+	r.header = header;
+	r.buffer = buffer;
+	r.size = size;
+	r.success = true;
+	return r;
+}
+
+auto read_duel_options(uint32_t flags, uint8_t* ptr, size_t size) noexcept
+	-> std::optional<DuelOptions>
+{
+	auto const* const sentry = ptr + size;
+	if(!skip_duelists(flags, ptr, sentry) ||
+	   !fits(ptr, sentry, sizeof(uint32_t) * 3U))
+		return std::nullopt;
+	DuelOptions o{};
+	o.starting_lp = read<uint32_t>(ptr);
+	o.starting_draw_count = read<uint32_t>(ptr);
+	o.draw_count_per_turn = read<uint32_t>(ptr);
+	return o;
+}
+
+auto read_decks(uint32_t flags, uint8_t* ptr, size_t size) noexcept
+	-> std::optional<Decks>
+{
+	auto const* const sentry = ptr + size;
+	auto const num_duelists = read_until_decks(flags, ptr, sentry);
+	if(!num_duelists)
+		return std::nullopt;
+	Decks decks;
+	// NOTE: Counts come from the replay, so each one is checked against
+	// what is left of the buffer before reading the codes it covers.
+	auto read_code_vector = [&](CodeVector& cv) noexcept -> bool
+	{
+		if(!fits(ptr, sentry, sizeof(uint32_t)))
+			return false;
+		auto const count = read<uint32_t>(ptr);
+		if(!fits(ptr, sentry, sizeof(uint32_t) * uint64_t{count}))
+			return false;
+		cv.reserve(count);
+		for(uint32_t i = 0U; i < count; i++)
+			cv.emplace_back(read<uint32_t>(ptr));
+		return true;
+	};
+	for(auto i = *num_duelists; i != 0; i--)
+	{
+		auto& d = decks.duelists.emplace_back();
+		if(!read_code_vector(d.first) || !read_code_vector(d.second))
+			return std::nullopt;
+	}
+	if(!read_code_vector(decks.extra_cards))
+		return std::nullopt;
+	return decks;
+}
+
+auto read_responses(uint32_t flags, uint8_t* buffer,
+                    size_t size) noexcept -> std::vector<Response>
+{
+	decltype(buffer) const sentry = buffer + size;
+	auto* ptr_to_resps = buffer;
+	auto const num_duelists = read_until_decks(flags, ptr_to_resps, sentry);
+	if(!num_duelists)
+		return {};
+	auto skip_code_vector = [&]() noexcept -> bool
+	{
+		if(!fits(ptr_to_resps, sentry, sizeof(uint32_t)))
+			return false;
+		auto const count = read<uint32_t>(ptr_to_resps);
+		if(!fits(ptr_to_resps, sentry, sizeof(uint32_t) * uint64_t{count}))
+			return false;
+		ptr_to_resps += sizeof(uint32_t) * size_t{count};
+		return true;
+	};
+	for(auto i = *num_duelists; i != 0; i--)
+		if(!skip_code_vector() || !skip_code_vector())
+			return {};
+	if(!skip_code_vector())
+		return {};
+	std::vector<Response> resps;
+	while(sentry != ptr_to_resps)
+	{
+		auto const resp_size = size_t{read<uint8_t>(ptr_to_resps)};
+		// NOTE: Stop at an empty or truncated response instead of reading
+		// past the end.
+		if(resp_size == 0U ||
+		   resp_size > static_cast<size_t>(sentry - ptr_to_resps))
+			break;
+		resps.emplace_back(ptr_to_resps, ptr_to_resps + resp_size);
+		ptr_to_resps += resp_size;
+	}
+	return resps;
+}
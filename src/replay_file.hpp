@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_REPLAY_FILE_HPP
+#define ERP_REPLAY_FILE_HPP
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string_view>
+#include <utility> // std::pair
+#include <vector>
+
+#include "replay_data.hpp"
+
+struct ReadHeaderResult
+{
+	bool success{};
+	ExtendedReplayHeader header{};
+};
+
+auto read_header(std::string_view exe, uint8_t const* buffer_data,
+                 ReplayTypes magic) noexcept -> ReadHeaderResult;
+
+struct LoadReplayResult
+{
+	bool success{};
+	ExtendedReplayHeader header{};
+	std::vector<uint8_t> buffer; // Contents after the header, decompressed.
+	uint64_t file_size{};        // As read, set even if loading failed.
+};
+
+// Reads and decompresses the yrpX replay at `fn`.
+auto load_replay(std::string_view exe,
+                 std::string_view fn) noexcept -> LoadReplayResult;
+
+// Same as above, reading the replay from `f` instead.
+auto load_replay(std::string_view exe,
+                 std::istream& f) noexcept -> LoadReplayResult;
+
+// The readers below take counts from the replay and check them against
+// what is left of the buffer (up to `sentry`, or `size` bytes from `ptr`),
+// returning nullopt if the replay is truncated.
+
+auto skip_duelists(uint32_t flags, uint8_t*& ptr,
+                   uint8_t const* sentry) noexcept
+	-> std::optional<unsigned>;
+
+auto read_duel_flags(uint32_t flags, uint8_t*& ptr,
+                     uint8_t const* sentry) noexcept
+	-> std::optional<uint64_t>;
+
+auto read_until_decks(uint32_t flags, uint8_t*& ptr,
+                      uint8_t const* sentry) noexcept
+	-> std::optional<unsigned>;
+
+struct LoadOldReplayResult
+{
+	bool success{};
+	ExtendedReplayHeader header{};
+	uint8_t* buffer{}; // Contents after the header, decompressed.
+	size_t size{};
+	std::vector<uint8_t> decompressed; // Backs `buffer` if it was compressed.
+};
+
+// Reads the yrp embedded in an OLD_REPLAY_MODE message, decompressing its
+// contents if needed.
+auto load_old_replay(std::string_view exe, uint8_t* buffer,
+                     size_t size) noexcept -> LoadOldReplayResult;
+
+struct DuelOptions
+{
+	uint32_t starting_lp;
+	uint32_t starting_draw_count;
+	uint32_t draw_count_per_turn;
+};
+
+// NOTE: Takes the contents of the embedded yrp, not the yrpX ones.
+auto read_duel_options(uint32_t flags, uint8_t* ptr, size_t size) noexcept
+	-> std::optional<DuelOptions>;
+
+using CodeVector = std::vector<uint32_t>;
+
+struct Decks
+{
+	std::vector<std::pair<CodeVector, CodeVector>> duelists; // Main, extra.
+	CodeVector extra_cards;
+};
+
+auto read_decks(uint32_t flags, uint8_t* ptr, size_t size) noexcept
+	-> std::optional<Decks>;
+
+using Response = std::vector<uint8_t>;
+
+// Stops at the first empty or truncated response, empty if the replay is
+// truncated before them.
+auto read_responses(uint32_t flags, uint8_t* buffer,
+                    size_t size) noexcept -> std::vector<Response>;
+
+#endif // ERP_REPLAY_FILE_HPP
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "replay_store.hpp"
+
+#include <algorithm> // std::min
+#include <array>
+#include <iostream>
+
+namespace
+{
+
+constexpr std::array<char, 8U> MAGIC{'E', 'R', 'P', 'P', 'S', '0', '0', '1'};
+constexpr uint32_t MESSAGES_PER_CHUNK = 256U;
+constexpr size_t HEADER_SIZE = MAGIC.size() + (2U * sizeof(uint32_t));
+
+auto write_le(std::string& out, uint64_t value, size_t width) noexcept -> void
+{
+	for(size_t i = 0U; i < width; i++)
+		out.push_back(static_cast<char>((value >> (8U * i)) & 0xFFU));
+}
+
+auto read_le(char const* data, size_t width) noexcept -> uint64_t
+{
+	uint64_t value = 0U;
+	for(size_t i = 0U; i < width; i++)
+		value |= uint64_t{static_cast<uint8_t>(data[i])} << (8U * i);
+	return value;
+}
+
+} // namespace
+
+auto write_replay_store(std::ostream& out,
+                        std::vector<std::string> const& blocks) noexcept
+	-> void
+{
+	auto const count = static_cast<uint32_t>(blocks.size());
+	auto const chunk_count =
+		(count + MESSAGES_PER_CHUNK - 1U) / MESSAGES_PER_CHUNK;
+	std::string head(MAGIC.data(), MAGIC.size());
+	write_le(head, count, 4U);
+	write_le(head, MESSAGES_PER_CHUNK, 4U);
+	uint64_t offset = HEADER_SIZE + ((uint64_t{chunk_count} + 1U) * 8U);
+	for(uint32_t i = 0U; i < count; i++)
+	{
+		if(i % MESSAGES_PER_CHUNK == 0U)
+			write_le(head, offset, 8U);
+		offset += 4U + blocks[i].size();
+	}
+	write_le(head, offset, 8U);
+	out.write(head.data(), head.size());
+	std::string size;
+	for(auto const& block : blocks)
+	{
+		size.clear();
+		write_le(size, block.size(), 4U);
+		out.write(size.data(), size.size());
+		out.write(block.data(), block.size());
+	}
+}
+
+auto ReplayStore::open(std::string_view exe, std::string_view path) noexcept
+	-> bool
+{
+	f_.open(std::string{path}, std::ios_base::binary | std::ios_base::in);
+	if(!f_.is_open())
+	{
+		std::cerr << exe << ": Could not open file '" << path << "'.\n";
+		return false;
+	}
+	std::array<char, HEADER_SIZE> head{};
+	f_.read(head.data(), head.size());
+	count_ = static_cast<uint32_t>(read_le(head.data() + MAGIC.size(), 4U));
+	per_chunk_ =
+		static_cast<uint32_t>(read_le(head.data() + MAGIC.size() + 4U, 4U));
+	if(!f_ || !std::equal(MAGIC.begin(), MAGIC.end(), head.begin()) ||
+	   per_chunk_ == 0U)
+	{
+		std::cerr << exe << ": Not a replay store.\n";
+		return false;
+	}
+	f_.seekg(0, std::ios_base::end);
+	auto const file_size = static_cast<uint64_t>(f_.tellg());
+	f_.seekg(static_cast<std::streamoff>(HEADER_SIZE));
+	auto const chunk_count = (uint64_t{count_} + per_chunk_ - 1U) / per_chunk_;
+	auto const index_end = HEADER_SIZE + ((chunk_count + 1U) * 8U);
+	// NOTE: Checked before allocating, the counts come from the file.
+	if(!f_ || index_end > file_size)
+	{
+		std::cerr << exe << ": Replay store index is truncated.\n";
+		return false;
+	}
+	std::string index((chunk_count + 1U) * 8U, '\0');
+	f_.read(index.data(), index.size());
+	if(!f_)
+	{
+		std::cerr << exe << ": Replay store index is truncated.\n";
+		return false;
+	}
+	offsets_.resize(chunk_count + 1U);
+	for(size_t i = 0U; i < offsets_.size(); i++)
+	{
+		offsets_[i] = read_le(index.data() + (i * 8U), 8U);
+		// NOTE: So that no chunk read later can be bigger than the file.
+		if(offsets_[i] < (i == 0U ? index_end : offsets_[i - 1U]) ||
+		   offsets_[i] > file_size)
+		{
+			std::cerr << exe << ": Replay store index is corrupted.\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+auto ReplayStore::read(std::string_view exe, uint32_t first, uint32_t count,
+                       std::vector<std::string>& blocks) noexcept -> bool
+{
+	if(first >= count_)
+		return true;
+	auto const last = first + std::min(count, count_ - first);
+	std::string chunk;
+	// NOTE: 64-bit, `per_chunk_` comes from the file and can be anything.
+	for(uint64_t c = first / per_chunk_; c * per_chunk_ < last; c++)
+	{
+		if(c + 1U >= offsets_.size())
+		{
+			std::cerr << exe << ": Replay store index is corrupted.\n";
+			return false;
+		}
+		chunk.resize(offsets_[c + 1U] - offsets_[c]);
+		f_.seekg(static_cast<std::streamoff>(offsets_[c]));
+		f_.read(chunk.data(), chunk.size());
+		if(!f_)
+		{
+			std::cerr << exe << ": Replay store chunk is truncated.\n";
+			return false;
+		}
+		size_t pos = 0U;
+		auto const chunk_last = std::min((c + 1U) * per_chunk_, uint64_t{last});
+		for(auto m = c * per_chunk_; m < chunk_last; m++)
+		{
+			if(chunk.size() - pos < 4U)
+			{
+				std::cerr << exe << ": Replay store chunk is corrupted.\n";
+				return false;
+			}
+			auto const size = read_le(chunk.data() + pos, 4U);
+			pos += 4U;
+			if(chunk.size() - pos < size)
+			{
+				std::cerr << exe << ": Replay store chunk is corrupted.\n";
+				return false;
+			}
+			if(m >= first)
+				blocks.emplace_back(chunk.data() + pos, size);
+			pos += size;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_REPLAY_STORE_HPP
+#define ERP_REPLAY_STORE_HPP
+#include <cstdint>
+#include <fstream>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Analyzed messages, stored so that any range of them can be loaded without
+// parsing the replay again. Little endian binary layout:
+//   char[8]   "ERPPS001"
+//   uint32    Number of messages.
+//   uint32    Messages per chunk, all chunks but the last are full.
+//   uint64[]  Offset of each chunk from the start of the file, plus one more
+//             with the size of the file.
+//   Per chunk, per message: uint32 size, then that many bytes of the binary
+//   protobuf of its `Replay.stream.blocks` entry.
+auto write_replay_store(std::ostream& out,
+                        std::vector<std::string> const& blocks) noexcept
+	-> void;
+
+// Reads the index of a replay store on open, then only the chunks holding
+// the messages asked for.
+class ReplayStore final
+{
+public:
+	auto open(std::string_view exe, std::string_view path) noexcept -> bool;
+
+	auto message_count() const noexcept -> uint32_t { return count_; }
+
+	// Appends messages [first, first + count) to `blocks`, clamped to the
+	// number of messages.
+	auto read(std::string_view exe, uint32_t first, uint32_t count,
+	          std::vector<std::string>& blocks) noexcept -> bool;
+
+private:
+	std::ifstream f_;
+	uint32_t count_{};
+	uint32_t per_chunk_{};
+	std::vector<uint64_t> offsets_;
+};
+
+#endif // ERP_REPLAY_STORE_HPP
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "result_cache.hpp"
+
+#include <functional> // std::hash
+
+namespace
+{
+
+// NOTE: Bookkeeping of an entry besides its key and value, so that many tiny
+// results can't go over the budget unnoticed.
+constexpr size_t ENTRY_OVERHEAD = 128U;
+
+auto entry_size(std::string const& key,
+                ResultCache::Value const& value) noexcept -> size_t
+{
+	return key.size() + value->size() + ENTRY_OVERHEAD;
+}
+
+} // namespace
+
+ResultCache::ResultCache(size_t budget) noexcept
+	: shard_budget_(budget / SHARD_COUNT)
+{}
+
+auto ResultCache::get(std::string const& key) noexcept -> Value
+{
+	auto& shard = shard_for(key);
+	std::scoped_lock lock(shard.mtx);
+	auto const it = shard.map.find(key);
+	if(it == shard.map.end())
+	{
+		misses_.fetch_add(1U, std::memory_order_relaxed);
+		return {};
+	}
+	hits_.fetch_add(1U, std::memory_order_relaxed);
+	shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+	return it->second->second;
+}
+
+auto ResultCache::put(std::string const& key, Value value) noexcept -> void
+{
+	auto const size = entry_size(key, value);
+	if(size > shard_budget_)
+		return;
+	auto& shard = shard_for(key);
+	std::scoped_lock lock(shard.mtx);
+	if(auto const it = shard.map.find(key); it != shard.map.end())
+	{
+		// NOTE: Two requests missed at once, keep the first result.
+		shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+		return;
+	}
+	while(shard.bytes + size > shard_budget_)
+	{
+		auto const& last = shard.lru.back();
+		shard.bytes -= entry_size(last.first, last.second);
+		shard.map.erase(last.first);
+		shard.lru.pop_back();
+		evictions_.fetch_add(1U, std::memory_order_relaxed);
+	}
+	shard.lru.emplace_front(key, std::move(value));
+	shard.map.emplace(shard.lru.front().first, shard.lru.begin());
+	shard.bytes += size;
+}
+
+auto ResultCache::stats() const noexcept -> Stats
+{
+	Stats s{hits_.load(std::memory_order_relaxed),
+	        misses_.load(std::memory_order_relaxed),
+	        evictions_.load(std::memory_order_relaxed),
+	        0U,
+	        0U,
+	        shard_budget_ * SHARD_COUNT};
+	for(auto const& shard : shards_)
+	{
+		std::scoped_lock lock(shard.mtx);
+		s.entries += shard.map.size();
+		s.bytes += shard.bytes;
+	}
+	return s;
+}
+
+auto ResultCache::shard_for(std::string const& key) noexcept -> Shard&
+{
+	return shards_[std::hash<std::string>{}(key) % SHARD_COUNT];
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_RESULT_CACHE_HPP
+#define ERP_RESULT_CACHE_HPP
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "shared_result.hpp"
+
+// Bounded LRU cache of serialized results, split into shards that each have
+// their own lock and an even part of the byte budget. Values are shared so
+// a reader can keep sending one after it was evicted.
+class ResultCache final
+{
+public:
+	using Value = std::shared_ptr<SharedResult const>;
+
+	struct Stats
+	{
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		uint64_t entries;
+		uint64_t bytes;
+		uint64_t budget;
+	};
+
+	explicit ResultCache(size_t budget) noexcept;
+
+	auto get(std::string const& key) noexcept -> Value;
+
+	// Values bigger than a shard's budget are not kept.
+	auto put(std::string const& key, Value value) noexcept -> void;
+
+	auto stats() const noexcept -> Stats;
+
+private:
+	static constexpr size_t SHARD_COUNT = 16U;
+
+	struct Shard
+	{
+		using Entry = std::pair<std::string, Value>;
+
+		mutable std::mutex mtx;
+		std::list<Entry> lru; // Most recently used first.
+		std::unordered_map<std::string_view, std::list<Entry>::iterator> map;
+		size_t bytes{};
+	};
+
+	auto shard_for(std::string const& key) noexcept -> Shard&;
+
+	size_t const shard_budget_;
+	std::array<Shard, SHARD_COUNT> shards_;
+	std::atomic<uint64_t> hits_{};
+	std::atomic<uint64_t> misses_{};
+	std::atomic<uint64_t> evictions_{};
+};
+
+#endif // ERP_RESULT_CACHE_HPP
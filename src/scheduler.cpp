@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "scheduler.hpp"
+
+Scheduler::Scheduler(unsigned slots, unsigned per_client) noexcept
+	: slots_(slots), per_client_(per_client)
+{}
+
+auto Scheduler::acquire(Priority priority, uint64_t client) noexcept -> void
+{
+	std::unique_lock<std::mutex> lock(mtx_);
+	bool const interactive = priority == Priority::INTERACTIVE;
+	if(interactive)
+	{
+		waiting_interactive_[client]++;
+		waiting_interactive_count_++;
+	}
+	else
+	{
+		waiting_bulk_++;
+	}
+	cv_.wait(lock,
+	         [&]()
+	         {
+				 return running_ < slots_ &&
+				        running_by_client_[client] < per_client_ &&
+				        (interactive || ready_interactive() == 0U);
+			 });
+	if(interactive)
+	{
+		if(--waiting_interactive_[client] == 0U)
+			waiting_interactive_.erase(client);
+		waiting_interactive_count_--;
+	}
+	else
+	{
+		waiting_bulk_--;
+	}
+	running_++;
+	running_by_client_[client]++;
+}
+
+auto Scheduler::release(uint64_t client) noexcept -> void
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		running_--;
+		if(--running_by_client_[client] == 0U)
+			running_by_client_.erase(client);
+	}
+	// NOTE: Waiters have different conditions, wake them all to recheck.
+	cv_.notify_all();
+}
+
+auto Scheduler::yield(Priority priority, uint64_t client) noexcept -> void
+{
+	// NOTE: Lock-free fast path, this is called every batch of messages.
+	if(priority != Priority::BULK || waiting_interactive_count_.load() == 0U)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		if(ready_interactive(client) == 0U)
+			return;
+		preemptions_++;
+	}
+	release(client);
+	acquire(priority, client);
+}
+
+auto Scheduler::stats() const noexcept -> Stats
+{
+	std::lock_guard<std::mutex> lock(mtx_);
+	return {running_, waiting_interactive_count_.load(), waiting_bulk_,
+	        preemptions_};
+}
+
+auto Scheduler::ready_interactive(std::optional<uint64_t> yielding) const
+	noexcept -> uint32_t
+{
+	uint32_t ready = 0U;
+	for(auto const& [client, waiting] : waiting_interactive_)
+	{
+		auto const it = running_by_client_.find(client);
+		auto const running = it == running_by_client_.end() ? 0U : it->second;
+		if(running - (client == yielding ? 1U : 0U) < per_client_)
+			ready += waiting;
+	}
+	return ready;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_SCHEDULER_HPP
+#define ERP_SCHEDULER_HPP
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+enum class Priority
+{
+	INTERACTIVE,
+	BULK,
+};
+
+// Hands out a fixed number of slots to run jobs in, interactive jobs first
+// and no more than `per_client` at once to the same client. A bulk job
+// calls `yield` between batches of work so it gives its slot away while an
+// interactive job waits for one, and gets back in line behind it.
+class Scheduler final
+{
+public:
+	struct Stats
+	{
+		uint32_t running;
+		uint32_t waiting_interactive;
+		uint32_t waiting_bulk;
+		uint64_t preemptions;
+	};
+
+	Scheduler(unsigned slots, unsigned per_client) noexcept;
+
+	auto acquire(Priority priority, uint64_t client) noexcept -> void;
+
+	auto release(uint64_t client) noexcept -> void;
+
+	auto yield(Priority priority, uint64_t client) noexcept -> void;
+
+	auto stats() const noexcept -> Stats;
+
+private:
+	// Interactive jobs that would run if a slot was free, that is, not held
+	// back by their client's quota, counting the job of `yielding` as gone.
+	auto ready_interactive(std::optional<uint64_t> yielding = std::nullopt)
+		const noexcept -> uint32_t;
+
+	unsigned const slots_;
+	unsigned const per_client_;
+	mutable std::mutex mtx_;
+	std::condition_variable cv_;
+	unsigned running_{};
+	uint32_t waiting_bulk_{};
+	std::unordered_map<uint64_t, unsigned> running_by_client_;
+	std::unordered_map<uint64_t, uint32_t> waiting_interactive_;
+	std::atomic<uint32_t> waiting_interactive_count_{};
+	uint64_t preemptions_{};
+};
+
+#endif // ERP_SCHEDULER_HPP
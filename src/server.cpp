@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "server.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring> // std::memcpy, std::strerror
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "metrics.hpp"
+#include "result_cache.hpp"
+#include "scheduler.hpp"
+#include "sha256.hpp"
+
+namespace
+{
+
+constexpr size_t MAX_REQUEST_SIZE = 64U * 1024U;
+constexpr unsigned MAX_CONNECTIONS = 1024U;
+
+// Removes `flag` from `args`, returning whether it was there.
+auto take_flag(std::vector<std::string_view>& args,
+               std::string_view flag) noexcept -> bool
+{
+	auto const it = std::remove(args.begin(), args.end(), flag);
+	bool const found = it != args.end();
+	args.erase(it, args.end());
+	return found;
+}
+
+auto send_all(int fd, std::string_view data) noexcept -> bool
+{
+	while(!data.empty())
+	{
+		auto const n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+		if(n == -1 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		data.remove_prefix(static_cast<size_t>(n));
+	}
+	return true;
+}
+
+auto send_result(int fd, std::string_view result) noexcept -> bool
+{
+	return send_all(fd, "OK " + std::to_string(result.size()) + '\n') &&
+	       send_all(fd, result);
+}
+
+// Passes the memfd of `result` along with the header instead of its bytes,
+// unless it has none.
+auto send_memfd(int fd, SharedResult const& result) noexcept -> bool
+{
+	if(result.fd() == -1)
+		return send_result(fd, result.view());
+	auto const header = "OK " + std::to_string(result.size()) + " memfd\n";
+	iovec iov{const_cast<char*>(header.data()), header.size()};
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+	msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1U;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	auto* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	int const result_fd = result.fd();
+	std::memcpy(CMSG_DATA(cmsg), &result_fd, sizeof(int));
+	ssize_t n{};
+	do
+		n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+	while(n == -1 && errno == EINTR);
+	// NOTE: The descriptor goes with the first byte, the rest can follow
+	// without it.
+	if(n <= 0)
+		return false;
+	return send_all(fd, std::string_view{header}.substr(
+							static_cast<size_t>(n)));
+}
+
+auto send_error(int fd, std::string_view message) noexcept -> bool
+{
+	return send_all(fd, "ERR " + std::string{message} + '\n');
+}
+
+// Reads requests one line at a time, keeping what came after the line.
+class LineReader
+{
+public:
+	explicit LineReader(int fd) noexcept : fd_(fd) {}
+
+	// Returns false on end of stream, error or a line that is too long.
+	auto next(std::string& line) noexcept -> bool
+	{
+		for(;;)
+		{
+			if(auto const nl = buffer_.find('\n'); nl != std::string::npos)
+			{
+				line.assign(buffer_, 0U, nl);
+				buffer_.erase(0U, nl + 1U);
+				return true;
+			}
+			if(buffer_.size() > MAX_REQUEST_SIZE)
+				return false;
+			char chunk[4096];
+			auto const n = recv(fd_, chunk, sizeof(chunk), 0);
+			if(n == -1 && errno == EINTR)
+				continue;
+			if(n <= 0)
+				return false;
+			buffer_.append(chunk, static_cast<size_t>(n));
+		}
+	}
+
+private:
+	int fd_;
+	std::string buffer_;
+};
+
+auto read_file(std::string const& fn, std::string& content) noexcept -> bool
+{
+	std::ifstream f(fn, std::ios_base::binary | std::ios_base::in);
+	if(!f.is_open())
+		return false;
+	content.assign(std::istreambuf_iterator<char>(f),
+	               std::istreambuf_iterator<char>());
+	return !f.bad();
+}
+
+struct Server
+{
+	std::string_view exe;
+	ServeHandler const& handler;
+	ResultCache cache;
+	Scheduler scheduler;
+
+	auto stats() const noexcept -> std::string
+	{
+		auto const s = cache.stats();
+		auto const q = scheduler.stats();
+		auto const lookups = s.hits + s.misses;
+		std::ostringstream out;
+		out << "hits " << s.hits << "\nmisses " << s.misses << "\nhit_rate "
+			<< (lookups == 0U ? 0.0 : static_cast<double>(s.hits) / lookups)
+			<< "\nevictions " << s.evictions << "\nentries " << s.entries
+			<< "\nbytes " << s.bytes << "\nbudget " << s.budget
+			<< "\nrunning " << q.running << "\nwaiting_interactive "
+			<< q.waiting_interactive << "\nwaiting_bulk " << q.waiting_bulk
+			<< "\npreemptions " << q.preemptions << '\n';
+		return out.str();
+	}
+
+	// Returns false if the connection should be closed.
+	auto answer(int fd, uint64_t client, std::string_view line) noexcept
+		-> bool
+	{
+		if(!line.empty() && line.back() == '\r')
+			line.remove_suffix(1U);
+		if(line == "STATS")
+			return send_result(fd, stats());
+		// Leading words starting with "--" are flags, the rest is the path.
+		std::vector<std::string_view> args;
+		while(line.substr(0U, 2U) == "--")
+		{
+			auto const end = std::min(line.find(' '), line.size());
+			args.push_back(line.substr(0U, end));
+			line.remove_prefix(std::min(end + 1U, line.size()));
+		}
+		if(line.empty())
+			return send_error(fd, "Expected a replay path.");
+		// NOTE: Not extractors, so they are not part of the key.
+		bool const memfd = take_flag(args, "--memfd");
+		auto const priority =
+			take_flag(args, "--bulk") ? Priority::BULK : Priority::INTERACTIVE;
+		auto send = [&](SharedResult const& result) -> bool
+		{
+			return memfd ? send_memfd(fd, result)
+			             : send_result(fd, result.view());
+		};
+		std::string const fn{line};
+		std::string content;
+		if(!read_file(fn, content))
+			return send_error(fd, "Could not open file '" + fn + "'.");
+		// NOTE: The key doesn't depend on the order flags were given in.
+		std::sort(args.begin(), args.end());
+		args.erase(std::unique(args.begin(), args.end()), args.end());
+		std::string key;
+		for(auto const arg : args)
+			key.append(arg).append(1U, ' ');
+		// NOTE: Results are shared by every client, so the key must not be
+		// forgeable: a replay that collides with another would hand its
+		// output to everyone asking for the other one.
+		auto const digest = sha256(content);
+		auto const size = static_cast<uint64_t>(content.size());
+		key.append(reinterpret_cast<char const*>(&size), sizeof(size));
+		key.append(reinterpret_cast<char const*>(digest.data()), digest.size());
+		if(auto const cached = cache.get(key); cached)
+			return send(*cached);
+		std::ostringstream out;
+		auto const prefixed_exe = std::string{exe} + ": " + fn;
+		auto const checkpoint = [&]() { scheduler.yield(priority, client); };
+		scheduler.acquire(priority, client);
+		bool const success =
+			handler(prefixed_exe, args, fn, content, checkpoint, out);
+		scheduler.release(client);
+		if(!success)
+			return send_error(fd, "Could not process replay.");
+		auto const result = std::make_shared<SharedResult const>(out.str());
+		metrics_bytes_out(result->size());
+		cache.put(key, result);
+		return send(*result);
+	}
+
+	auto handle(int fd) noexcept -> void
+	{
+		ucred cred{};
+		socklen_t len = sizeof(cred);
+		getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len);
+		auto const client = static_cast<uint64_t>(cred.pid);
+		LineReader reader(fd);
+		std::string line;
+		while(reader.next(line))
+			if(!answer(fd, client, line))
+				break;
+	}
+};
+
+} // namespace
+
+auto serve(std::string_view exe, std::string_view socket_path,
+           ServeOptions const& options, ServeHandler const& handler) noexcept
+	-> bool
+{
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if(socket_path.size() >= sizeof(addr.sun_path))
+	{
+		std::cerr << exe << ": Socket path is too long.\n";
+		return false;
+	}
+	std::memcpy(addr.sun_path, socket_path.data(), socket_path.size());
+	// NOTE: Only a socket left behind by a previous run is replaced.
+	if(struct stat st{}; lstat(addr.sun_path, &st) == 0)
+	{
+		if(!S_ISSOCK(st.st_mode))
+		{
+			std::cerr << exe << ": '" << socket_path
+					  << "' exists and is not a socket.\n";
+			return false;
+		}
+		unlink(addr.sun_path);
+	}
+	int const fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd == -1 ||
+	   bind(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0 ||
+	   listen(fd, SOMAXCONN) != 0)
+	{
+		std::cerr << exe << ": Could not listen on '" << socket_path
+				  << "': " << std::strerror(errno) << ".\n";
+		if(fd != -1)
+			close(fd);
+		return false;
+	}
+	Server server{exe, handler, ResultCache{options.cache_bytes},
+	              Scheduler{options.jobs, options.client_jobs}};
+	auto add_value = [&](std::string name, std::string help, std::string type,
+	                     auto read)
+	{
+		metrics_add_value("erp_serve_" + name, std::move(help),
+		                  std::move(type),
+		                  [&server, read]() -> double { return read(server); });
+	};
+	add_value("cache_hits_total", "Requests answered from the cache.",
+	          "counter",
+	          [](Server const& s) { return s.cache.stats().hits; });
+	add_value("cache_misses_total", "Requests that had to be parsed.",
+	          "counter",
+	          [](Server const& s) { return s.cache.stats().misses; });
+	add_value("cache_evictions_total", "Results evicted from the cache.",
+	          "counter",
+	          [](Server const& s) { return s.cache.stats().evictions; });
+	add_value("cache_bytes", "Bytes held by the cache.", "gauge",
+	          [](Server const& s) { return s.cache.stats().bytes; });
+	add_value("running", "Requests being parsed.", "gauge",
+	          [](Server const& s) { return s.scheduler.stats().running; });
+	add_value("waiting_interactive", "Interactive requests waiting.", "gauge",
+	          [](Server const& s)
+	          { return s.scheduler.stats().waiting_interactive; });
+	add_value("waiting_bulk", "Bulk requests waiting.", "gauge",
+	          [](Server const& s) { return s.scheduler.stats().waiting_bulk; });
+	add_value("preemptions_total", "Bulk requests that gave way.", "counter",
+	          [](Server const& s) { return s.scheduler.stats().preemptions; });
+	// NOTE: A thread per connection, they mostly wait on the client or on
+	// the scheduler. How many parse at once is up to the scheduler.
+	std::mutex mtx;
+	std::condition_variable closed;
+	unsigned connections = 0U;
+	for(;;)
+	{
+		int const client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if(client == -1)
+		{
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			std::cerr << exe << ": Could not accept connection: "
+					  << std::strerror(errno) << ".\n";
+			break;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if(connections == MAX_CONNECTIONS)
+			{
+				send_error(client, "Too many connections.");
+				close(client);
+				continue;
+			}
+			connections++;
+		}
+		std::thread(
+			[&, client]()
+			{
+				server.handle(client);
+				close(client);
+				// NOTE: Notified under the lock, `serve` may return as soon
+				// as it's released.
+				std::lock_guard<std::mutex> lock(mtx);
+				connections--;
+				closed.notify_one();
+			})
+			.detach();
+	}
+	close(fd);
+	std::unique_lock<std::mutex> lock(mtx);
+	closed.wait(lock, [&]() { return connections == 0U; });
+	metrics_remove_values("erp_serve_");
+	return false;
+}
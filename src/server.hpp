@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_SERVER_HPP
+#define ERP_SERVER_HPP
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Writes what the flags in `args` ask for about the replay whose file
+// contents are `content` to `out`, calling `checkpoint` between batches of
+// messages. Returns false on error.
+using ServeHandler = std::function<bool(
+	std::string_view exe, std::vector<std::string_view> const& args,
+	std::string_view fn, std::string const& content,
+	std::function<void()> const& checkpoint, std::ostream& out)>;
+
+struct ServeOptions
+{
+	unsigned jobs;       // Requests parsed at once.
+	unsigned client_jobs; // Of those, how many can be from the same client.
+	size_t cache_bytes;
+};
+
+// Answers requests on the Unix socket at `socket_path` until killed. Each
+// request is a line made of flags followed by the path of a replay:
+//   --duel-msgs --names /path/to/replay.yrpX\n
+// And is answered with either of:
+//   OK <size>\n<size bytes of output>
+//   ERR <message>\n
+// Besides the flags for `handler`, requests take:
+//   --memfd  The output is not sent, instead the header reads
+//            "OK <size> memfd" and carries a sealed memfd holding it
+//            (SCM_RIGHTS) for the client to map, or the usual answer where
+//            memfds are not available. Clients close it when done, there
+//            is no release call.
+//   --bulk   Only parse it while no interactive request (the default) is
+//            waiting, pausing between batches of messages if one comes.
+// A client is the process on the other end of the connection, requests on
+// the same connection are answered in order.
+// Results are cached by the contents of the replay and the set of flags,
+// using up to `cache_bytes`. The request line "STATS" is answered with the
+// cache and queue counters instead. Returns false if the socket can't be
+// set up.
+auto serve(std::string_view exe, std::string_view socket_path,
+           ServeOptions const& options, ServeHandler const& handler) noexcept
+	-> bool;
+
+#endif // ERP_SERVER_HPP
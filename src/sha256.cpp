@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "sha256.hpp"
+
+#include <algorithm> // std::min
+
+namespace
+{
+
+constexpr std::array<uint32_t, 64U> K{
+	0x428A2F98U, 0x71374491U, 0xB5C0FBCFU, 0xE9B5DBA5U, 0x3956C25BU,
+	0x59F111F1U, 0x923F82A4U, 0xAB1C5ED5U, 0xD807AA98U, 0x12835B01U,
+	0x243185BEU, 0x550C7DC3U, 0x72BE5D74U, 0x80DEB1FEU, 0x9BDC06A7U,
+	0xC19BF174U, 0xE49B69C1U, 0xEFBE4786U, 0x0FC19DC6U, 0x240CA1CCU,
+	0x2DE92C6FU, 0x4A7484AAU, 0x5CB0A9DCU, 0x76F988DAU, 0x983E5152U,
+	0xA831C66DU, 0xB00327C8U, 0xBF597FC7U, 0xC6E00BF3U, 0xD5A79147U,
+	0x06CA6351U, 0x14292967U, 0x27B70A85U, 0x2E1B2138U, 0x4D2C6DFCU,
+	0x53380D13U, 0x650A7354U, 0x766A0ABBU, 0x81C2C92EU, 0x92722C85U,
+	0xA2BFE8A1U, 0xA81A664BU, 0xC24B8B70U, 0xC76C51A3U, 0xD192E819U,
+	0xD6990624U, 0xF40E3585U, 0x106AA070U, 0x19A4C116U, 0x1E376C08U,
+	0x2748774CU, 0x34B0BCB5U, 0x391C0CB3U, 0x4ED8AA4AU, 0x5B9CCA4FU,
+	0x682E6FF3U, 0x748F82EEU, 0x78A5636FU, 0x84C87814U, 0x8CC70208U,
+	0x90BEFFFAU, 0xA4506CEBU, 0xBEF9A3F7U, 0xC67178F2U};
+
+constexpr size_t BLOCK_SIZE = 64U;
+
+constexpr auto rotr(uint32_t x, unsigned n) noexcept -> uint32_t
+{
+	return (x >> n) | (x << (32U - n));
+}
+
+} // namespace
+
+Sha256::Sha256() noexcept
+	: state_{0x6A09E667U, 0xBB67AE85U, 0x3C6EF372U, 0xA54FF53AU,
+	         0x510E527FU, 0x9B05688CU, 0x1F83D9ABU, 0x5BE0CD19U}
+{}
+
+auto Sha256::update(std::string_view data) noexcept -> void
+{
+	auto const* p = reinterpret_cast<uint8_t const*>(data.data());
+	auto left = data.size();
+	total_ += left;
+	if(block_size_ != 0U)
+	{
+		auto const n = std::min(left, BLOCK_SIZE - block_size_);
+		std::copy(p, p + n, block_.begin() + block_size_);
+		block_size_ += n;
+		p += n;
+		left -= n;
+		if(block_size_ < BLOCK_SIZE)
+			return;
+		compress(block_.data());
+		block_size_ = 0U;
+	}
+	for(; left >= BLOCK_SIZE; left -= BLOCK_SIZE, p += BLOCK_SIZE)
+		compress(p);
+	std::copy(p, p + left, block_.begin());
+	block_size_ = left;
+}
+
+auto Sha256::finish() noexcept -> Sha256Digest
+{
+	auto const bits = total_ * 8U;
+	block_[block_size_++] = 0x80U;
+	if(block_size_ > BLOCK_SIZE - sizeof(uint64_t))
+	{
+		std::fill(block_.begin() + block_size_, block_.end(), uint8_t{});
+		compress(block_.data());
+		block_size_ = 0U;
+	}
+	std::fill(block_.begin() + block_size_, block_.end() - sizeof(uint64_t),
+	          uint8_t{});
+	for(size_t i = 0U; i < sizeof(uint64_t); i++)
+		block_[BLOCK_SIZE - 1U - i] = static_cast<uint8_t>(bits >> (8U * i));
+	compress(block_.data());
+	Sha256Digest d{};
+	for(size_t i = 0U; i < state_.size(); i++)
+		for(size_t j = 0U; j < sizeof(uint32_t); j++)
+			d[(i * 4U) + j] =
+				static_cast<uint8_t>(state_[i] >> (24U - (8U * j)));
+	return d;
+}
+
+auto Sha256::compress(uint8_t const* block) noexcept -> void
+{
+	std::array<uint32_t, 64U> w{};
+	for(size_t i = 0U; i < 16U; i++)
+		w[i] = (uint32_t{block[i * 4U]} << 24U) |
+		       (uint32_t{block[(i * 4U) + 1U]} << 16U) |
+		       (uint32_t{block[(i * 4U) + 2U]} << 8U) |
+		       uint32_t{block[(i * 4U) + 3U]};
+	for(size_t i = 16U; i < w.size(); i++)
+	{
+		auto const s0 =
+			rotr(w[i - 15U], 7U) ^ rotr(w[i - 15U], 18U) ^ (w[i - 15U] >> 3U);
+		auto const s1 =
+			rotr(w[i - 2U], 17U) ^ rotr(w[i - 2U], 19U) ^ (w[i - 2U] >> 10U);
+		w[i] = w[i - 16U] + s0 + w[i - 7U] + s1;
+	}
+	auto s = state_;
+	for(size_t i = 0U; i < w.size(); i++)
+	{
+		auto const [a, b, c, d, e, f, g, h] = s;
+		auto const t1 = h + (rotr(e, 6U) ^ rotr(e, 11U) ^ rotr(e, 25U)) +
+		                ((e & f) ^ (~e & g)) + K[i] + w[i];
+		auto const t2 = (rotr(a, 2U) ^ rotr(a, 13U) ^ rotr(a, 22U)) +
+		                ((a & b) ^ (a & c) ^ (b & c));
+		s = {t1 + t2, a, b, c, d + t1, e, f, g};
+	}
+	for(size_t i = 0U; i < state_.size(); i++)
+		state_[i] += s[i];
+}
+
+auto sha256(std::string_view data) noexcept -> Sha256Digest
+{
+	Sha256 h;
+	h.update(data);
+	return h.finish();
+}
+
+auto hmac_sha256(std::string_view key, std::string_view data) noexcept
+	-> Sha256Digest
+{
+	std::array<uint8_t, BLOCK_SIZE> k{};
+	if(key.size() > BLOCK_SIZE)
+	{
+		auto const d = sha256(key);
+		std::copy(d.begin(), d.end(), k.begin());
+	}
+	else
+	{
+		std::copy(key.begin(), key.end(), k.begin());
+	}
+	auto pad = [&](uint8_t x)
+	{
+		auto p = k;
+		for(auto& c : p)
+			c ^= x;
+		return p;
+	};
+	auto as_view = [](auto const& a)
+	{
+		return std::string_view{reinterpret_cast<char const*>(a.data()),
+		                        a.size()};
+	};
+	Sha256 inner;
+	inner.update(as_view(pad(0x36U)));
+	inner.update(data);
+	auto const inner_digest = inner.finish();
+	Sha256 outer;
+	outer.update(as_view(pad(0x5CU)));
+	outer.update(as_view(inner_digest));
+	return outer.finish();
+}
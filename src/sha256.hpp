@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_SHA256_HPP
+#define ERP_SHA256_HPP
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// SHA-256 (FIPS 180-4) and HMAC-SHA256 (RFC 2104), for where inputs may be
+// picked by an adversary: cache keys shared between clients and pseudonyms.
+// See hash.hpp for the fast, non-cryptographic hashes.
+
+using Sha256Digest = std::array<uint8_t, 32U>;
+
+class Sha256 final
+{
+public:
+	Sha256() noexcept;
+
+	auto update(std::string_view data) noexcept -> void;
+
+	// Pads and returns the digest, the object must not be used afterwards.
+	auto finish() noexcept -> Sha256Digest;
+
+private:
+	auto compress(uint8_t const* block) noexcept -> void;
+
+	std::array<uint32_t, 8U> state_;
+	std::array<uint8_t, 64U> block_{};
+	size_t block_size_{};
+	uint64_t total_{};
+};
+
+auto sha256(std::string_view data) noexcept -> Sha256Digest;
+
+auto hmac_sha256(std::string_view key, std::string_view data) noexcept
+	-> Sha256Digest;
+
+#endif // ERP_SHA256_HPP
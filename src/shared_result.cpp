@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "shared_result.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+
+auto write_all(int fd, std::string_view data) noexcept -> bool
+{
+	while(!data.empty())
+	{
+		auto const n = write(fd, data.data(), data.size());
+		if(n == -1 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		data.remove_prefix(static_cast<size_t>(n));
+	}
+	return true;
+}
+
+} // namespace
+
+SharedResult::SharedResult(std::string data) noexcept : size_(data.size())
+{
+	int const fd = memfd_create("erp-result", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	// NOTE: Sealed so no client can change what the others are reading.
+	if(fd == -1 || !write_all(fd, data) ||
+	   fcntl(fd, F_ADD_SEALS,
+	         F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+	{
+		if(fd != -1)
+			close(fd);
+		fallback_ = std::move(data);
+		return;
+	}
+	if(size_ != 0U)
+	{
+		map_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+		if(map_ == MAP_FAILED)
+		{
+			map_ = nullptr;
+			close(fd);
+			fallback_ = std::move(data);
+			return;
+		}
+	}
+	fd_ = fd;
+}
+
+SharedResult::~SharedResult() noexcept
+{
+	if(map_ != nullptr)
+		munmap(map_, size_);
+	if(fd_ != -1)
+		close(fd_);
+}
+
+auto SharedResult::view() const noexcept -> std::string_view
+{
+	if(fd_ == -1)
+		return fallback_;
+	return {static_cast<char const*>(map_), size_};
+}
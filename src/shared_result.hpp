@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_SHARED_RESULT_HPP
+#define ERP_SHARED_RESULT_HPP
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Serialized result kept in a sealed memfd, so that local clients can be
+// handed the descriptor and map it instead of reading it from a socket.
+// The kernel counts the references to the memory: it's released once this
+// object, and every client that received the descriptor, let go of it.
+// Where memfds are not available the result is kept in a string instead and
+// `fd` returns -1.
+class SharedResult final
+{
+public:
+	explicit SharedResult(std::string data) noexcept;
+	SharedResult(SharedResult const&) = delete;
+	SharedResult& operator=(SharedResult const&) = delete;
+	~SharedResult() noexcept;
+
+	auto view() const noexcept -> std::string_view;
+
+	auto size() const noexcept -> size_t { return size_; }
+
+	auto fd() const noexcept -> int { return fd_; }
+
+private:
+	std::string fallback_;
+	size_t size_{};
+	int fd_{-1};
+	void* map_{};
+};
+
+#endif // ERP_SHARED_RESULT_HPP
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "tensors.hpp"
+
+#include <algorithm> // std::min
+#include <array>
+#include <cstring> // std::memcpy
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+
+constexpr size_t BOARD_WIDTH = 20U;
+constexpr size_t RESPONSE_WIDTH = 64U;
+
+#pragma pack(push, 1)
+struct Record
+{
+	uint32_t msg_index;
+	uint32_t request;
+	std::array<int32_t, BOARD_WIDTH> board;
+	uint32_t response_size;
+	std::array<uint8_t, RESPONSE_WIDTH> response;
+};
+#pragma pack(pop)
+
+auto flatten(BoardStats const& s) noexcept -> std::array<int32_t, BOARD_WIDTH>
+{
+	std::array<int32_t, BOARD_WIDTH> b{};
+	auto* ptr = b.data();
+	auto put = [&ptr](uint32_t v) { *ptr++ = static_cast<int32_t>(v); };
+	put(s.turn);
+	put(s.turn_controller);
+	put(s.phase);
+	put(s.chain_size);
+	for(auto const* a : {&s.lp, &s.main_deck, &s.hand, &s.extra_deck,
+	                     &s.graveyard, &s.banished, &s.monster_zones,
+	                     &s.spell_zones})
+	{
+		put((*a)[0]);
+		put((*a)[1]);
+	}
+	return b;
+}
+
+// See https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html
+auto npy_header(size_t rows) noexcept -> std::string
+{
+	std::string dict = "{'descr': [('msg_index', '<u4'), ('request', '<u4'), "
+	                   "('board', '<i4', (" +
+	                   std::to_string(BOARD_WIDTH) +
+	                   ",)), ('response_size', '<u4'), ('response', '|u1', (" +
+	                   std::to_string(RESPONSE_WIDTH) +
+	                   ",))], 'fortran_order': False, 'shape': (" +
+	                   std::to_string(rows) + ",), }";
+	// NOTE: Magic (6) + version (2) + header length (2) + dict + newline,
+	// padded with spaces so the data starts 64-byte aligned.
+	auto const unpadded = 10U + dict.size() + 1U;
+	dict.append((64U - (unpadded % 64U)) % 64U, ' ');
+	dict.push_back('\n');
+	std::string header{"\x93NUMPY\x01\x00", 8U};
+	auto const len = static_cast<uint16_t>(dict.size());
+	header.push_back(static_cast<char>(len & 0xFFU));
+	header.push_back(static_cast<char>(len >> 8U));
+	return header + dict;
+}
+
+} // namespace
+
+auto write_tensors(std::string_view exe, std::string_view path,
+                   std::vector<Decision> const& decisions,
+                   std::vector<std::vector<uint8_t>> const& responses) noexcept
+	-> bool
+{
+	static_assert(sizeof(Record) == 4U + 4U + (4U * BOARD_WIDTH) + 4U +
+	                                    RESPONSE_WIDTH);
+	if(responses.size() != decisions.size() &&
+	   responses.size() + 1U != decisions.size())
+	{
+		std::cerr << exe << ": Replay has " << decisions.size()
+				  << " decisions but " << responses.size()
+				  << " responses, can't pair them.\n";
+		return false;
+	}
+	std::ofstream f(std::string{path},
+	                std::ios_base::binary | std::ios_base::out);
+	auto const header = npy_header(decisions.size());
+	f.write(header.data(), header.size());
+	for(size_t i = 0U; i < decisions.size(); i++)
+	{
+		auto const& d = decisions[i];
+		Record r{d.msg_index, d.request_type, flatten(d.board), 0U, {}};
+		if(i < responses.size())
+		{
+			auto const& resp = responses[i];
+			r.response_size = static_cast<uint32_t>(resp.size());
+			std::memcpy(r.response.data(), resp.data(),
+			            std::min(resp.size(), RESPONSE_WIDTH));
+		}
+		f.write(reinterpret_cast<char const*>(&r), sizeof(Record));
+	}
+	if(!f)
+	{
+		std::cerr << exe << ": Could not write tensors to '" << path << "'.\n";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_TENSORS_HPP
+#define ERP_TENSORS_HPP
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "parser.hpp"
+
+// Writes one record per decision to `path` as a NumPy structured array:
+//   msg_index      uint32   Index of the request in the message stream.
+//   request        uint32   Type of request (Msg.Request oneof case).
+//   board          int32[N] Flattened `BoardStats` at the time of request.
+//   response_size  uint32   Size of the response taken, may exceed the
+//                           width of `response`, in which case it's cut.
+//   response       uint8[M] Response bytes, zero padded.
+// The n-th decision is paired with the n-th response in the replay. Only the
+// last decision may lack one (the duel ended while waiting on it), any other
+// count mismatch means they can't be paired and fails.
+auto write_tensors(std::string_view exe, std::string_view path,
+                   std::vector<Decision> const& decisions,
+                   std::vector<std::vector<uint8_t>> const& responses) noexcept
+	-> bool;
+
+#endif // ERP_TENSORS_HPP
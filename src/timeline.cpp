@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "timeline.hpp"
+
+#include <algorithm> // std::min
+#include <bitset>
+#include <limits>
+#include <ostream>
+#include <string_view>
+
+namespace
+{
+
+struct Column
+{
+	std::string_view name;
+	uint8_t width;
+};
+
+constexpr std::array<Column, Timeline::COLUMN_COUNT> COLUMNS{{
+	{"msg", 4U},
+	{"turn", 2U},
+	{"turn_player", 1U},
+	{"phase", 2U},
+	{"lp0", 4U},
+	{"lp1", 4U},
+	{"hand0", 2U},
+	{"hand1", 2U},
+	{"deck0", 2U},
+	{"deck1", 2U},
+	{"gy0", 2U},
+	{"gy1", 2U},
+	{"banished0", 2U},
+	{"banished1", 2U},
+	{"monsters0", 1U},
+	{"monsters1", 1U},
+	{"chain_links", 2U},
+}};
+
+auto write_le(std::ostream& out, uint32_t value, uint8_t width) noexcept
+	-> void
+{
+	// NOTE: Values that do not fit are saturated.
+	auto const max = width >= 4U ? std::numeric_limits<uint32_t>::max()
+	                             : (uint32_t{1U} << (8U * width)) - 1U;
+	value = std::min(value, max);
+	for(uint8_t i = 0U; i < width; i++)
+		out.put(static_cast<char>((value >> (8U * i)) & 0xFFU));
+}
+
+} // namespace
+
+auto Timeline::append(uint32_t msg_index, BoardStats const& s,
+                      uint32_t chain_links) noexcept -> void
+{
+	auto* c = columns.data();
+	auto put = [&c](uint32_t value) { (c++)->push_back(value); };
+	put(msg_index);
+	put(s.turn);
+	put(s.turn_controller);
+	put(s.phase);
+	for(auto const* a : {&s.lp, &s.hand, &s.main_deck, &s.graveyard,
+	                     &s.banished})
+	{
+		put((*a)[0]);
+		put((*a)[1]);
+	}
+	put(static_cast<uint32_t>(std::bitset<32>(s.monster_zones[0]).count()));
+	put(static_cast<uint32_t>(std::bitset<32>(s.monster_zones[1]).count()));
+	put(chain_links);
+}
+
+auto print_timeline_json(std::ostream& out, Timeline const& tl) noexcept
+	-> void
+{
+	out << "{\"timeline\":{";
+	auto* pad1 = "";
+	for(size_t i = 0U; i < Timeline::COLUMN_COUNT; i++)
+	{
+		out << pad1 << '"' << COLUMNS[i].name << "\":[";
+		pad1 = ",";
+		auto* pad2 = "";
+		for(auto const value : tl.columns[i])
+		{
+			out << pad2 << value;
+			pad2 = ",";
+		}
+		out << ']';
+	}
+	out << "}}\n";
+}
+
+auto write_timeline_binary(std::ostream& out, Timeline const& tl) noexcept
+	-> void
+{
+	out.write("ERPTL001", 8U);
+	write_le(out, static_cast<uint32_t>(tl.columns[0].size()), 4U);
+	write_le(out, static_cast<uint32_t>(Timeline::COLUMN_COUNT), 4U);
+	for(auto const& c : COLUMNS)
+	{
+		out.put(static_cast<char>(c.name.size()));
+		out.write(c.name.data(), c.name.size());
+		out.put(static_cast<char>(c.width));
+	}
+	for(size_t i = 0U; i < Timeline::COLUMN_COUNT; i++)
+		for(auto const value : tl.columns[i])
+			write_le(out, value, COLUMNS[i].width);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_TIMELINE_HPP
+#define ERP_TIMELINE_HPP
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+#include "board_stats.hpp"
+
+// Board stats sampled at each turn and phase boundary, stored one column per
+// field. The first row is the state before any message and the last one the
+// state after every message (with `msg` being the message count).
+// Columns, in order:
+//   msg           Index in the message stream where the boundary happened.
+//   turn, turn_player, phase
+//   lp0, lp1, hand0, hand1, deck0, deck1, gy0, gy1, banished0, banished1
+//   monsters0, monsters1  Monsters on the field.
+//   chain_links   Chain links added since the previous sample.
+struct Timeline
+{
+	static constexpr size_t COLUMN_COUNT = 17U;
+
+	std::array<std::vector<uint32_t>, COLUMN_COUNT> columns;
+
+	auto append(uint32_t msg_index, BoardStats const& s,
+	            uint32_t chain_links) noexcept -> void;
+};
+
+// {"timeline":{"msg":[...],"turn":[...],...}}
+auto print_timeline_json(std::ostream& out, Timeline const& tl) noexcept
+	-> void;
+
+// Little endian binary layout:
+//   char[8]  "ERPTL001"
+//   uint32   Number of rows.
+//   uint32   Number of columns.
+//   Per column: uint8 name length, name, uint8 value width in bytes.
+//   Per column: the values of every row at that column's width.
+auto write_timeline_binary(std::ostream& out, Timeline const& tl) noexcept
+	-> void;
+
+#endif // ERP_TIMELINE_HPP
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "trajectory.hpp"
+
+#include <algorithm> // std::find_if, std::swap
+#include <cstring>   // std::memcpy
+#include <ostream>
+
+namespace
+{
+
+#include "read.inl"
+
+// NOTE: Core message numbers and locations as used by edo9300's ocgcore.
+constexpr uint8_t MSG_POS_CHANGE = 53U;
+constexpr uint8_t MSG_MOVE = 50U;
+constexpr uint8_t MSG_SWAP = 55U;
+constexpr uint8_t MSG_DRAW = 90U;
+
+constexpr uint8_t LOCATION_DECK = 0x01U;
+constexpr uint8_t LOCATION_HAND = 0x02U;
+constexpr uint8_t LOCATION_MZONE = 0x04U;
+constexpr uint8_t LOCATION_SZONE = 0x08U;
+constexpr uint8_t LOCATION_GRAVE = 0x10U;
+constexpr uint8_t LOCATION_REMOVED = 0x20U;
+constexpr uint8_t LOCATION_EXTRA = 0x40U;
+constexpr uint8_t LOCATION_OVERLAY = 0x80U;
+
+// controller (1) + location (1) + sequence (4) + position (4)
+constexpr size_t LOC_INFO_SIZE = 10U;
+
+} // namespace
+
+CardTracker::CardTracker() noexcept
+{
+	for(auto& zones : monster_zones_)
+		zones.fill(NO_CARD);
+	for(auto& zones : spell_zones_)
+		zones.fill(NO_CARD);
+}
+
+auto CardTracker::track(uint32_t msg_index, uint32_t turn, uint8_t msg_type,
+                        uint8_t const* data, size_t size) noexcept -> void
+{
+	msg_index_ = msg_index;
+	turn_ = turn;
+	auto read_loc_info = [&data]() -> LocInfo
+	{
+		LocInfo l{};
+		l.con = read<uint8_t>(data) & 1U;
+		l.loc = read<uint8_t>(data);
+		l.seq = read<uint32_t>(data);
+		l.pos = read<uint32_t>(data);
+		return l;
+	};
+	switch(msg_type)
+	{
+	case MSG_MOVE:
+	{
+		if(size < 4U + (2U * LOC_INFO_SIZE))
+			return;
+		auto const code = read<uint32_t>(data);
+		auto const from = read_loc_info();
+		auto const to = read_loc_info();
+		put(take(code, from), code, to);
+		move_overlay(from, to);
+		return;
+	}
+	case MSG_POS_CHANGE:
+	{
+		if(size < 4U + 5U)
+			return;
+		auto const code = read<uint32_t>(data);
+		LocInfo l{};
+		l.con = read<uint8_t>(data) & 1U;
+		l.loc = read<uint8_t>(data);
+		l.seq = read<uint8_t>(data);
+		read<uint8_t>(data); // Previous position.
+		l.pos = read<uint8_t>(data);
+		put(take(code, l), code, l);
+		return;
+	}
+	case MSG_SWAP:
+	{
+		if(size < 2U * (4U + LOC_INFO_SIZE))
+			return;
+		auto const code1 = read<uint32_t>(data);
+		auto const l1 = read_loc_info();
+		auto const code2 = read<uint32_t>(data);
+		auto const l2 = read_loc_info();
+		auto const id1 = take(code1, l1);
+		auto const id2 = take(code2, l2);
+		put(id1, code1, l2);
+		put(id2, code2, l1);
+		move_overlay(l1, l2);
+		return;
+	}
+	case MSG_DRAW:
+	{
+		if(size < 1U + 4U)
+			return;
+		LocInfo deck{};
+		deck.con = read<uint8_t>(data) & 1U;
+		deck.loc = LOCATION_DECK;
+		auto const count = read<uint32_t>(data);
+		if(size < 1U + 4U + (size_t{count} * 8U))
+			return;
+		for(uint32_t i = 0U; i < count; i++)
+		{
+			auto const code = read<uint32_t>(data);
+			LocInfo hand = deck;
+			hand.loc = LOCATION_HAND;
+			hand.seq = static_cast<uint32_t>(pile(hand)->size());
+			hand.pos = read<uint32_t>(data);
+			deck.seq = static_cast<uint32_t>(pile(deck)->size());
+			if(deck.seq != 0U)
+				deck.seq--;
+			put(take(code, deck), code, hand);
+		}
+		return;
+	}
+	default:
+		return;
+	}
+}
+
+auto CardTracker::take_trajectories() noexcept -> std::vector<Trajectory>
+{
+	decltype(cards_) taken{};
+	std::swap(taken, cards_);
+	return taken;
+}
+
+auto CardTracker::take(uint32_t code, LocInfo const& from) noexcept -> uint32_t
+{
+	auto id = NO_CARD;
+	if(auto* z = zone(from); z != nullptr)
+	{
+		std::swap(id, *z);
+	}
+	else if(auto* p = (from.loc & LOCATION_OVERLAY) != 0U ? overlay(from)
+	                                                      : pile(from);
+	        p != nullptr)
+	{
+		auto const seq = (from.loc & LOCATION_OVERLAY) != 0U ? from.pos
+		                                                     : from.seq;
+		auto matches = [&](uint32_t i)
+		{ return code == 0U || cards_[i].code == 0U || cards_[i].code == code; };
+		auto it = p->end();
+		if(seq < p->size() && matches((*p)[seq]))
+			it = p->begin() + seq;
+		else if(code != 0U)
+			it = std::find_if(p->begin(), p->end(), [&](uint32_t i)
+			                  { return cards_[i].code == code; });
+		if(it != p->end())
+		{
+			id = *it;
+			p->erase(it);
+		}
+	}
+	if(id != NO_CARD)
+		return id;
+	// First time this card is seen, it starts being tracked where it was.
+	id = static_cast<uint32_t>(cards_.size());
+	cards_.emplace_back();
+	if(from.loc != 0U)
+		step(id, code, from);
+	return id;
+}
+
+auto CardTracker::put(uint32_t id, uint32_t code, LocInfo const& to) noexcept
+	-> void
+{
+	step(id, code, to);
+	if(auto* z = zone(to); z != nullptr)
+	{
+		*z = id;
+	}
+	else if(auto* p = (to.loc & LOCATION_OVERLAY) != 0U ? overlay(to)
+	                                                    : pile(to);
+	        p != nullptr)
+	{
+		auto const seq = (to.loc & LOCATION_OVERLAY) != 0U ? to.pos : to.seq;
+		p->insert(p->begin() + std::min<size_t>(seq, p->size()), id);
+	}
+}
+
+auto CardTracker::move_overlay(LocInfo const& from,
+                               LocInfo const& to) noexcept -> void
+{
+	if(from.loc != LOCATION_MZONE || to.loc != LOCATION_MZONE)
+		return;
+	// NOTE: Swapped, so that swapping two monsters swaps their materials too.
+	auto* a = overlay(from);
+	auto* b = overlay(to);
+	if(a != nullptr && b != nullptr && a != b)
+		std::swap(*a, *b);
+}
+
+auto CardTracker::step(uint32_t id, uint32_t code,
+                       LocInfo const& at) noexcept -> void
+{
+	auto& card = cards_[id];
+	if(card.code == 0U)
+		card.code = code;
+	card.steps.push_back({msg_index_, turn_, at.con, at.loc, at.seq, at.pos});
+}
+
+auto CardTracker::zone(LocInfo const& l) noexcept -> uint32_t*
+{
+	if(l.seq >= ZONE_COUNT)
+		return nullptr;
+	if(l.loc == LOCATION_MZONE)
+		return &monster_zones_[l.con][l.seq];
+	if(l.loc == LOCATION_SZONE)
+		return &spell_zones_[l.con][l.seq];
+	return nullptr;
+}
+
+auto CardTracker::pile(LocInfo const& l) noexcept -> std::vector<uint32_t>*
+{
+	switch(l.loc)
+	{
+	case LOCATION_DECK:
+		return &piles_[l.con][0U];
+	case LOCATION_HAND:
+		return &piles_[l.con][1U];
+	case LOCATION_GRAVE:
+		return &piles_[l.con][2U];
+	case LOCATION_REMOVED:
+		return &piles_[l.con][3U];
+	case LOCATION_EXTRA:
+		return &piles_[l.con][4U];
+	default:
+		return nullptr;
+	}
+}
+
+auto CardTracker::overlay(LocInfo const& l) noexcept -> std::vector<uint32_t>*
+{
+	if(l.seq >= ZONE_COUNT)
+		return nullptr;
+	return &overlays_[l.con][l.seq];
+}
+
+auto print_trajectories_json(std::ostream& out,
+                             std::vector<Trajectory> const& t) noexcept -> void
+{
+	out << "{\"trajectories\":[";
+	auto* pad1 = "";
+	for(auto const& card : t)
+	{
+		out << pad1 << "{\"code\":" << card.code << ",\"steps\":[";
+		pad1 = ",";
+		auto* pad2 = "";
+		for(auto const& s : card.steps)
+		{
+			out << pad2 << '[' << s.msg_index << ',' << s.turn << ','
+				<< uint32_t{s.con} << ',' << uint32_t{s.loc} << ',' << s.seq
+				<< ',' << s.pos << ']';
+			pad2 = ",";
+		}
+		out << "]}";
+	}
+	out << "]}\n";
+}
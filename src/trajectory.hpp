@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_TRAJECTORY_HPP
+#define ERP_TRAJECTORY_HPP
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+struct TrajectoryStep
+{
+	uint32_t msg_index;
+	uint32_t turn;
+	uint8_t con;
+	uint8_t loc;
+	uint32_t seq;
+	uint32_t pos;
+};
+
+// Every place a physical card has been at, in order. `code` is 0 until the
+// card is revealed.
+struct Trajectory
+{
+	uint32_t code;
+	std::vector<TrajectoryStep> steps;
+};
+
+// Follows physical cards through the raw core messages that move them
+// (MSG_MOVE, MSG_POS_CHANGE, MSG_SWAP and MSG_DRAW). Cards are tracked
+// from the first time they are seen. Piles are not seeded, so cards leaving
+// a pile are matched by code when their position is not known. Xyz materials
+// are kept by monster zone and follow their monster when it changes zones.
+class CardTracker final
+{
+public:
+	CardTracker() noexcept;
+
+	auto track(uint32_t msg_index, uint32_t turn, uint8_t msg_type,
+	           uint8_t const* data, size_t size) noexcept -> void;
+
+	auto take_trajectories() noexcept -> std::vector<Trajectory>;
+
+private:
+	static constexpr uint32_t NO_CARD = UINT32_MAX;
+	static constexpr size_t PILE_COUNT = 5U;
+	static constexpr size_t ZONE_COUNT = 8U;
+
+	struct LocInfo
+	{
+		uint8_t con;
+		uint8_t loc;
+		uint32_t seq;
+		uint32_t pos;
+	};
+
+	auto take(uint32_t code, LocInfo const& from) noexcept -> uint32_t;
+	auto put(uint32_t id, uint32_t code, LocInfo const& to) noexcept -> void;
+	auto move_overlay(LocInfo const& from, LocInfo const& to) noexcept
+		-> void;
+	auto step(uint32_t id, uint32_t code, LocInfo const& at) noexcept -> void;
+	auto zone(LocInfo const& l) noexcept -> uint32_t*;
+	auto pile(LocInfo const& l) noexcept -> std::vector<uint32_t>*;
+	auto overlay(LocInfo const& l) noexcept -> std::vector<uint32_t>*;
+
+	uint32_t msg_index_{};
+	uint32_t turn_{};
+	std::vector<Trajectory> cards_;
+	std::array<std::array<std::vector<uint32_t>, PILE_COUNT>, 2U> piles_;
+	std::array<std::array<uint32_t, ZONE_COUNT>, 2U> monster_zones_;
+	std::array<std::array<uint32_t, ZONE_COUNT>, 2U> spell_zones_;
+	std::array<std::array<std::vector<uint32_t>, ZONE_COUNT>, 2U> overlays_;
+};
+
+// {"trajectories":[{"code":C,"steps":[[msg,turn,con,loc,seq,pos],...]},...]}
+auto print_trajectories_json(std::ostream& out,
+                             std::vector<Trajectory> const& t) noexcept
+	-> void;
+
+#endif // ERP_TRAJECTORY_HPP
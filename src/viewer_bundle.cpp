@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "viewer_bundle.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+#include "json.hpp"
+#include "parser.hpp" // blocks_to_json
+
+namespace
+{
+
+struct TurnRange
+{
+	uint32_t turn;
+	uint32_t first;
+	uint32_t count;
+};
+
+// NOTE: The timeline samples every turn and phase change, only the turn
+// changes matter here. Messages before the first turn are turn 0.
+auto turn_ranges(Timeline const& timeline, uint32_t message_count) noexcept
+	-> std::vector<TurnRange>
+{
+	auto const& msg = timeline.columns[0];
+	auto const& turn = timeline.columns[1];
+	std::vector<TurnRange> ranges{{0U, 0U, 0U}};
+	for(size_t i = 0U; i < msg.size(); i++)
+	{
+		if(turn[i] == ranges.back().turn)
+			continue;
+		// NOTE: The message that starts a turn belongs to it.
+		auto const first = std::min(msg[i], message_count);
+		ranges.back().count = first - ranges.back().first;
+		ranges.push_back({turn[i], first, 0U});
+	}
+	ranges.back().count = message_count - ranges.back().first;
+	if(ranges.front().count == 0U && ranges.size() > 1U)
+		ranges.erase(ranges.begin());
+	return ranges;
+}
+
+auto print_codes(std::ostream& out, CodeVector const& codes) noexcept -> void
+{
+	out << '[';
+	auto* pad = "";
+	for(auto const code : codes)
+	{
+		out << pad << code;
+		pad = ",";
+	}
+	out << ']';
+}
+
+} // namespace
+
+auto write_viewer_bundle(std::string_view exe, std::string_view dir,
+                         BundleInfo const& info, Timeline const& timeline,
+                         std::vector<std::string> const& blocks) noexcept
+	-> bool
+{
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	if(ec)
+	{
+		std::cerr << exe << ": Could not create directory '" << dir << "'.\n";
+		return false;
+	}
+	auto const count = static_cast<uint32_t>(blocks.size());
+	auto const ranges = turn_ranges(timeline, count);
+	auto write = [&](std::string const& name, auto&& print) -> bool
+	{
+		auto const path = (std::filesystem::path{dir} / name).string();
+		std::ofstream f(path, std::ios_base::binary | std::ios_base::out);
+		print(f);
+		if(!f)
+		{
+			std::cerr << exe << ": Could not write file '" << path << "'.\n";
+			return false;
+		}
+		return true;
+	};
+	for(auto const& r : ranges)
+	{
+		auto const json = blocks_to_json(
+			{blocks.begin() + r.first, blocks.begin() + r.first + r.count});
+		if(!json.has_value())
+		{
+			std::cerr << exe << ": Could not serialize turn " << r.turn
+					  << ".\n";
+			return false;
+		}
+		if(!write("turn-" + std::to_string(r.turn) + ".json",
+		          [&](std::ostream& out) { out << *json << '\n'; }))
+			return false;
+	}
+	// NOTE: Written last, so its presence means the bundle is complete.
+	return write(
+		"manifest.json",
+		[&](std::ostream& out)
+		{
+			out << "{\"names\":[";
+			auto* pad = "";
+			for(auto const& name : info.names.names)
+			{
+				out << pad;
+				print_json_string(out, name);
+				pad = ",";
+			}
+			out << "],\"team1_count\":" << info.names.team1_count
+				<< ",\"date\":" << info.date << ",\"decks\":[";
+			pad = "";
+			for(auto const& d : info.decks.duelists)
+			{
+				out << pad << "{\"main\":";
+				print_codes(out, d.first);
+				out << ",\"extra\":";
+				print_codes(out, d.second);
+				out << '}';
+				pad = ",";
+			}
+			out << "],\"rules\":";
+			print_codes(out, info.decks.extra_cards);
+			out << ",\"messages\":" << count << ",\"turns\":[";
+			pad = "";
+			for(auto const& r : ranges)
+			{
+				out << pad << "{\"turn\":" << r.turn << ",\"first\":" << r.first
+					<< ",\"count\":" << r.count << ",\"file\":\"turn-"
+					<< r.turn << ".json\"}";
+				pad = ",";
+			}
+			out << "]}\n";
+		});
+}
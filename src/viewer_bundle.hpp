@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef ERP_VIEWER_BUNDLE_HPP
+#define ERP_VIEWER_BUNDLE_HPP
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "print_names.hpp"
+#include "replay_file.hpp"
+#include "timeline.hpp"
+
+struct BundleInfo
+{
+	DuelistNames names;
+	uint32_t date; // Unix timestamp.
+	Decks decks;
+};
+
+// Writes the messages of a replay split by turn so a viewer can show the
+// first turn before fetching the rest:
+//   DIR/manifest.json  {"names":[...],"team1_count":N,"date":D,
+//                       "decks":[{"main":[...],"extra":[...]},...],
+//                       "rules":[...],"messages":M,
+//                       "turns":[{"turn":T,"first":F,"count":C,
+//                                 "file":"turn-T.json"},...]}
+//   DIR/turn-T.json    Messages of turn T, in the format of --duel-msgs.
+// Turn boundaries come from `timeline`, `blocks` are as returned by
+// `analyze`. Returns false on error.
+auto write_viewer_bundle(std::string_view exe, std::string_view dir,
+                         BundleInfo const& info, Timeline const& timeline,
+                         std::vector<std::string> const& blocks) noexcept
+	-> bool;
+
+#endif // ERP_VIEWER_BUNDLE_HPP
@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+# Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+#
+# SPDX-License-Identifier: AGPL-3.0-or-later
+#
+# Crafted replays that stress the worst cases of each stage, and a runner that
+# checks erp gets through them within a time and address space limit.
+#   tools/hostile_replays.py ERP CASE
+#   tools/hostile_replays.py --write DIR
+# The first form builds the replay for CASE and runs ERP over it, failing if
+# erp crashes, times out or runs out of memory; rejecting the replay is fine.
+# The second one writes every replay to DIR, for reproducing by hand.
+# Usually run through `meson test --suite hostile`, see meson.build.
+import lzma
+import os
+import resource
+import struct
+import subprocess
+import sys
+import tempfile
+
+YRP1 = 0x31707279
+YRPX = 0x58707279
+COMPRESSED = 0x1
+SINGLE_MODE = 0x8
+DUELFLAG_64BIT = 0x100
+EXTENDED_HEADER = 0x200
+FLAGS = SINGLE_MODE | DUELFLAG_64BIT | EXTENDED_HEADER
+VERSION = 10 << 16  # Core version 10, the oldest erp parses.
+
+MSG_WAITING = 3
+MSG_UPDATE_DATA = 6
+MSG_MOVE = 50
+OLD_REPLAY_MODE = 231
+
+LOCATION_DECK = 0x01
+LOCATION_HAND = 0x02
+LOCATION_MZONE = 0x04
+LOCATION_EXTRA = 0x40
+LOCATION_OVERLAY = 0x80
+QUERY_CODE = 0x1
+QUERY_END = 0x80000000
+REASON_XYZ = 0x200000 | 0x8  # REASON_MATERIAL too.
+
+
+def header(type_, flags, size, props=bytes(8)):
+	# ReplayHeader followed by ExtendedReplayHeader, see replay_data.hpp.
+	return struct.pack('<6I8sQ4Q', type_, VERSION, flags, 1700000000, size,
+	                   0, props, 1, 1, 2, 3, 4)
+
+
+def compress(body):
+	# NOTE: Replays keep the 5 bytes of LZMA properties in the header and
+	# store neither the 8 byte size of the .lzma format nor an end marker.
+	data = lzma.compress(body, format=lzma.FORMAT_ALONE, filters=[
+		{'id': lzma.FILTER_LZMA1, 'preset': 1, 'dict_size': 1 << 20}])
+	return data[:5] + bytes(3), data[13:]
+
+
+def name(s):
+	b = s.encode('utf-16-le')
+	return b + bytes(40 - len(b))
+
+
+def names():
+	return name('Hostile') + name('Replay')
+
+
+def u32s(values):
+	return struct.pack('<%dI' % len(values), *values)
+
+
+def message(type_, payload=b''):
+	return struct.pack('<BI', type_, len(payload)) + payload
+
+
+def yrp1(responses=()):
+	body = names() + u32s([8000, 5, 1]) + struct.pack('<Q', 0)
+	for _ in range(2):  # Main and extra deck of each duelist.
+		body += u32s([3, 89631139, 89631139, 89631139]) + u32s([0])
+	body += u32s([0])  # Extra cards.
+	body += b''.join(bytes([len(r)]) + r for r in responses)
+	props, data = compress(body)
+	return header(YRP1, FLAGS | COMPRESSED, len(body), props) + data
+
+
+def yrpx(messages, embedded=None, size=None):
+	body = names() + struct.pack('<Q', 0) + messages
+	body += message(OLD_REPLAY_MODE, embedded or yrp1())
+	props, data = compress(body)
+	size = len(body) if size is None else size
+	return header(YRPX, FLAGS | COMPRESSED, size, props) + data
+
+
+def loc_info(con, loc, seq, pos=0):
+	return struct.pack('<BBII', con, loc, seq, pos)
+
+
+def move(code, prev, cur, reason=0):
+	return message(MSG_MOVE, struct.pack('<I', code) + prev + cur +
+	               struct.pack('<I', reason))
+
+
+def huge_size():
+	# A few bytes of body claiming to decompress to 4 GiB.
+	return yrpx(b'', size=0xFFFFFFFF)
+
+
+def empty_messages():
+	return yrpx(message(MSG_WAITING) * 2000000)
+
+
+def missing_cards():
+	# Every query points to an empty hand, so all of them are dropped.
+	query = struct.pack('<HII', 8, QUERY_CODE, 89631139)
+	query += struct.pack('<HI', 4, QUERY_END)
+	update = message(MSG_UPDATE_DATA,
+	                 struct.pack('<BB', 0, LOCATION_HAND) + query * 5000)
+	return yrpx(update * 50)
+
+
+def long_responses():
+	return yrpx(b'', embedded=yrp1([struct.pack('<I', i) for i in
+	                                range(500000)]))
+
+
+def xyz_chains(depth=300):
+	# Each Xyz Monster is summoned using the previous one as its material,
+	# which carries every material below it along.
+	zone = 0
+	messages = [move(1, loc_info(0, LOCATION_DECK, 0),
+	                 loc_info(0, LOCATION_MZONE, zone))]
+	for level in range(depth):
+		top = 1000 + level
+		other = 1 - zone
+		messages.append(move(top, loc_info(0, LOCATION_EXTRA, 0),
+		                     loc_info(0, LOCATION_MZONE, other)))
+		for pos in range(level):
+			messages.append(move(
+				2000 + pos, loc_info(0, LOCATION_MZONE | LOCATION_OVERLAY,
+				                     zone, pos),
+				loc_info(0, LOCATION_MZONE | LOCATION_OVERLAY, other, pos),
+				REASON_XYZ))
+		messages.append(move(
+			top - 1, loc_info(0, LOCATION_MZONE, zone),
+			loc_info(0, LOCATION_MZONE | LOCATION_OVERLAY, other, level),
+			REASON_XYZ))
+		zone = other
+	return yrpx(b''.join(messages))
+
+
+# Replay, erp flags, wall-clock limit in seconds and address space limit in
+# MiB. Limits leave a few times the headroom a healthy build needs.
+CASES = {
+	'huge-size': (huge_size, ['--names', '--duel-msgs'], 10, 512),
+	'empty-messages': (empty_messages, ['--timeline'], 60, 2048),
+	'missing-cards': (missing_cards, ['--duel-msgs'], 30, 1024),
+	'long-responses': (long_responses, ['--duel-resps', '--duel-prompts'],
+	                   30, 1024),
+	'xyz-chains': (xyz_chains, ['--trajectories', '--timeline'], 30, 1024),
+}
+
+
+def run(erp, case):
+	make, flags, seconds, mib = CASES[case]
+	limit = mib << 20
+
+	def limit_memory():
+		resource.setrlimit(resource.RLIMIT_AS, (limit, limit))
+
+	with tempfile.TemporaryDirectory() as tmp:
+		path = os.path.join(tmp, case + '.yrpX')
+		with open(path, 'wb') as f:
+			f.write(make())
+		try:
+			r = subprocess.run([erp] + flags + [path],
+			                   stdout=subprocess.DEVNULL,
+			                   preexec_fn=limit_memory, timeout=seconds)
+		except subprocess.TimeoutExpired:
+			print('%s: %s took longer than %d s.' % (sys.argv[0], case,
+			                                         seconds), file=sys.stderr)
+			return False
+	# NOTE: Replays may be rejected, only a crash (a signal, which is also how
+	# an allocation past the limit ends) fails the test.
+	if r.returncode < 0:
+		print('%s: %s killed by signal %d (limit %d MiB).' %
+		      (sys.argv[0], case, -r.returncode, mib), file=sys.stderr)
+		return False
+	return True
+
+
+def main():
+	if len(sys.argv) == 3 and sys.argv[1] == '--write':
+		for case, (make, _, _, _) in CASES.items():
+			with open(os.path.join(sys.argv[2], case + '.yrpX'), 'wb') as f:
+				f.write(make())
+		return 0
+	if len(sys.argv) != 3 or sys.argv[2] not in CASES:
+		print('Usage: %s ERP {%s}\n       %s --write DIR' %
+		      (sys.argv[0], ','.join(CASES), sys.argv[0]), file=sys.stderr)
+		return 1
+	return 0 if run(sys.argv[1], sys.argv[2]) else 1
+
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+#
+# SPDX-License-Identifier: AGPL-3.0-or-later
+#
+# Training workload for profile-guided builds: runs an instrumented erp over
+# a directory of replays with the flags that exercise decompression, message
+# parsing and serialization, both on one thread and in batch mode.
+#   tools/pgo_train.sh ERP CORPUS_DIR [CARD_DB]
+# Usually run through `ninja pgo-train`, see meson.build.
+set -eu
+
+if [ $# -lt 2 ]; then
+	echo "Usage: $0 ERP CORPUS_DIR [CARD_DB]" >&2
+	exit 1
+fi
+erp=$1
+corpus=$2
+card_db=${3:-}
+# NOTE: Meson runs targets from the build directory, relative paths given to
+# the pgo_* options are taken from the source directory instead.
+from_source() {
+	case $1 in
+	/*) echo "$1" ;;
+	*) echo "${MESON_SOURCE_ROOT:-.}/$1" ;;
+	esac
+}
+corpus=$(from_source "$corpus")
+[ -n "$card_db" ] && card_db=$(from_source "$card_db")
+
+# NOTE: Replays are split on whitespace, so their names must not contain any.
+replays=$(find "$corpus" -type f \( -name '*.yrp' -o -name '*.yrpX' \) | sort)
+if [ -z "$replays" ]; then
+	echo "$0: No replays in '$corpus'." >&2
+	exit 1
+fi
+
+train() {
+	# NOTE: Replays that fail to parse are still worth the profile, so their
+	# exit status is ignored.
+	for replay in $replays; do
+		"$erp" "$@" "$replay" > /dev/null 2>&1 || true
+	done
+	# shellcheck disable=SC2086
+	"$erp" -j 0 "$@" $replays > /dev/null 2>&1 || true
+}
+
+train --names --date --decks --duel-seed --duel-options
+train --duel-msgs --duel-resps
+train --duel-prompts --timeline --trajectories
+if [ -n "$card_db" ]; then
+	train --card-db "$card_db" --duel-msgs --timeline
+fi
+echo "Trained on $(echo "$replays" | wc -l) replays."
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+#
+# SPDX-License-Identifier: AGPL-3.0-or-later
+#
+# Compares how long erp and erp-lite take to answer a header-only query,
+# which is dominated by process startup.
+#   tools/startup_bench.sh BUILD_DIR REPLAY [RUNS] [FLAGS...]
+# Build erp-lite first with `ninja -C BUILD_DIR erp-lite`. FLAGS default to
+# --date.
+set -eu
+
+if [ $# -lt 2 ]; then
+	echo "Usage: $0 BUILD_DIR REPLAY [RUNS] [FLAGS...]" >&2
+	exit 1
+fi
+build_dir=$1
+replay=$2
+runs=${3:-200}
+shift $(($# < 3 ? $# : 3))
+[ $# -eq 0 ] && set -- --date
+
+now_ns() {
+	date +%s%N
+}
+
+bench() {
+	exe=$1
+	shift
+	"$exe" "$@" "$replay" > /dev/null # Warm up the page cache.
+	start=$(now_ns)
+	i=0
+	while [ $i -lt "$runs" ]; do
+		"$exe" "$@" "$replay" > /dev/null
+		i=$((i + 1))
+	done
+	end=$(now_ns)
+	echo $(((end - start) / runs / 1000))
+}
+
+full=$(bench "$build_dir/erp" "$@")
+lite=$(bench "$build_dir/erp-lite" "$@")
+echo "erp:      $full us per run"
+echo "erp-lite: $lite us per run"
+echo "speedup:  $(awk "BEGIN { printf \"%.2f\", $full / $lite }")x"